@@ -109,6 +109,14 @@ MainWindow::MainWindow(BaseObjectType *base,
     overlay->add_overlay(spinner);
     overlay->set_overlay_pass_through(spinner);
 
+    Gtk::Box *controlBox = nullptr;
+    builder->get_widget("box2", controlBox);
+    searchEntry.set_placeholder_text("Search");
+    controlBox->pack_end(searchEntry, false, false);
+    searchEntry.show();
+    searchEntry.signal_search_changed().connect(
+        [this] { on_searchChanged(); });
+
     Gtk::Button *playButton, *pauseButton, *skipForwardButton,
         *skipBackwardButton;
     builder->get_widget("play-button", playButton);
@@ -155,6 +163,10 @@ MainWindow::MainWindow(BaseObjectType *base,
         sigc::mem_fun(this, &MainWindow::om_streamUrlReceived));
     signal_localStorageUpdateCompleted.connect(
         sigc::mem_fun(this, &MainWindow::on_localDataUpdated));
+    signal_syncProgress.connect(
+        sigc::mem_fun(this, &MainWindow::on_syncProgress));
+    session.setSyncProgressCallback(
+        [this](const SyncStats &) { signal_syncProgress.emit(); });
 
     signal_playbackProgress.connect(
         sigc::mem_fun(this, &MainWindow::on_playbackProgressUpdated));
@@ -185,6 +197,7 @@ MainWindow::MainWindow(BaseObjectType *base,
         loadTracks();
     }
     player.setDelegate(this);
+    player.setCache(&session.getAudioCache());
 
     auto volume = session.getStorage().getValueForKey<double>("volume");
     if (!volume) {
@@ -218,6 +231,20 @@ void MainWindow::on_playbackProgressUpdated()
 
 void MainWindow::on_playbackStarted()
 {
+    // The player moves on to the queued track by itself.
+    auto trackId = player.getTrackId();
+    if (!trackId.empty() && trackId != playedTrack.track.trackId) {
+        Gtk::TreeIter iter;
+        if (playlistWrapper &&
+            playlistWrapper->peekNext(PlayListMode::Seq, iter) &&
+            static_cast<const std::string &>((*iter)[modelColumns.trackId]) ==
+                trackId) {
+            playlistWrapper->next(PlayListMode::Seq, iter);
+        }
+        playedTrack.update(
+            session.getDatabase()->getTrackTable().get(trackId));
+    }
+
     auto artist = session.getDatabase()->getArtistTable().get(
         playedTrack.track.artistIds.at(0));
     auto album =
@@ -230,6 +257,7 @@ void MainWindow::on_playbackStarted()
     auto adjustment = playbackProgressWidget->get_adjustment();
     scaleSetValue(adjustment->get_lower());
     updateSelection(playedTrack.track.trackId);
+    queueNextTrack();
 }
 
 void MainWindow::on_playbackFinished()
@@ -263,7 +291,7 @@ void MainWindow::om_streamUrlReceived()
     try {
         auto trackUrl = TASK(std::string, std::string).get();
         //        player.playURL(trackUrl);
-        player.playTrack(trackUrl);
+        player.playTrack(playedTrack.track.trackId, trackUrl);
     } catch (const ApiRequestHttpException &exc) {
         if (exc.error.code == HttpErrorCode::UNAUTHORIZED) {
             showErrorDialog("You are not authorized. Please login.");
@@ -281,33 +309,59 @@ void MainWindow::on_localDataUpdated()
     spinner.stop();
     try {
         TASK(void).get();
-        auto artists = session.getDatabase()->getArtistTable().getAll();
-        for (const auto &artist : artists) {
-            auto row                       = *(sideTreeModel->append());
-            row[sideTreeModelColumns.name] = artist.name;
-            row[sideTreeModelColumns.id]   = artist.artistId;
-            row[sideTreeModelColumns.type] = RowType::Artist;
-            auto albums =
-                session.getDatabase()->getAlbumTable().getAllForArtist(
-                    artist.artistId);
-            for (const auto &album : albums) {
-                auto childRow = *(sideTreeModel->append(row.children()));
-                childRow[sideTreeModelColumns.name] = album.name;
+        auto artistAlbums =
+            session.getDatabase()->getArtistTable().getAllWithAlbums();
+        sideTreeModel->clear();
+        Gtk::TreeModel::iterator artistIter;
+        std::string currentArtistId;
+        for (const auto &item : artistAlbums) {
+            if (!artistIter || item.artistId != currentArtistId) {
+                artistIter                     = sideTreeModel->append();
+                auto row                       = *artistIter;
+                row[sideTreeModelColumns.name] = item.artistName;
+                row[sideTreeModelColumns.id]   = item.artistId;
+                row[sideTreeModelColumns.type] = RowType::Artist;
+                currentArtistId                = item.artistId;
+            }
+            if (!item.albumId.empty()) {
+                auto childRow =
+                    *(sideTreeModel->append(artistIter->children()));
+                childRow[sideTreeModelColumns.name] = item.albumName;
                 childRow[sideTreeModelColumns.type] = RowType::Album;
-                childRow[sideTreeModelColumns.id]   = album.albumId;
+                childRow[sideTreeModelColumns.id]   = item.albumId;
             }
         }
-        currentTracks = session.getDatabase()->getTrackTable().getAll(
-            db::TrackTable::TrackType::Regular);
-        fillTrackTreeView();
+        fillTrackTreeView(playlistWrapper != nullptr);
     } catch (const std::exception &exc) {
         showErrorDialog(exc.what());
     }
 }
 
+void MainWindow::on_syncProgress()
+{
+    // Show tracks as sync pages land, but don't rebuild the list for every
+    // page of a large library.
+    auto now = std::chrono::steady_clock::now();
+    if (now - lastListingRefresh < std::chrono::seconds(2)) {
+        return;
+    }
+    lastListingRefresh = now;
+    try {
+        fillTrackTreeView(true);
+    } catch (const std::exception &exc) {
+        ERRLOG << exc.what() << std::endl;
+    }
+}
+
 void MainWindow::setupTreeView()
 {
     filterFunc = [this](const Gtk::TreeModel::iterator &iter) -> bool {
+        if (filterParams.searchActive) {
+            const std::string &trackId = (*iter)[modelColumns.trackId];
+            if (filterParams.searchMatches.count(trackId) == 0) {
+                return false;
+            }
+        }
         if (filterParams.pattern.empty()) {
             return true;
         }
@@ -413,6 +467,29 @@ void MainWindow::setupSideTreeView()
         });
 }
 
+void MainWindow::on_searchChanged()
+{
+    std::string text = searchEntry.get_text();
+    filterParams.searchMatches.clear();
+    filterParams.searchActive =
+        text.find_first_not_of(" \t") != std::string::npos;
+    if (filterParams.searchActive) {
+        try {
+            // Every match is needed to filter the view.
+            auto trackIds = session.getDatabase()->getTrackTable().search(
+                text, db::TrackTable::noLimit);
+            filterParams.searchMatches.insert(trackIds.begin(),
+                                              trackIds.end());
+        } catch (const std::exception &exc) {
+            showErrorDialog(exc.what());
+        }
+    }
+    treeModelFilter->refilter();
+    if (player.inProgress()) {
+        updateSelection(playedTrack.track.trackId);
+    }
+}
+
 void MainWindow::showErrorDialog(const std::string &errMsg)
 {
     Gtk::MessageDialog dlg(*this, errMsg, false, Gtk::MESSAGE_ERROR);
@@ -469,6 +546,17 @@ void MainWindow::play(const Gtk::TreeIter &iter)
     using std::string;
     const string &trackId = (*iter)[modelColumns.trackId];
     playedTrack.update(session.getDatabase()->getTrackTable().get(trackId));
+    player.cancelQueued();
+
+    // Cached tracks need no stream url, so they start without the network.
+    if (session.getAudioCache().contains(trackId)) {
+        try {
+            player.playTrack(trackId, string());
+        } catch (const std::exception &exc) {
+            showErrorDialog(exc.what());
+        }
+        return;
+    }
     TASK(string, string)
         .setJob([this](std::atomic_bool *, string trackId) -> string {
             return session.getApi()->getTrackApi().getStreamUrl(trackId);
@@ -485,6 +573,21 @@ void MainWindow::playNext()
     }
 }
 
+// The stream url is asked for by the player when it prefetches the track,
+// so it is still fresh when the track starts.
+void MainWindow::queueNextTrack()
+{
+    Gtk::TreeIter iter;
+    if (!playlistWrapper ||
+        !playlistWrapper->peekNext(PlayListMode::Seq, iter)) {
+        return;
+    }
+    std::string trackId = (*iter)[modelColumns.trackId];
+    player.queueNext(trackId, [this, trackId] {
+        return session.getApi()->getTrackApi().getStreamUrl(trackId);
+    });
+}
+
 void MainWindow::playPrev()
 {
     Gtk::TreeIter iter;
@@ -493,25 +596,31 @@ void MainWindow::playPrev()
     }
 }
 
-void MainWindow::fillTrackTreeView()
+// Clearing the list invalidates the iterators the playlist holds, so while
+// one is active only tracks that are not listed yet are appended. Deleted
+// tracks then stay listed until the next full refresh.
+void MainWindow::fillTrackTreeView(bool appendOnly)
 {
-    treeModel->clear();
-    for (const auto &track : currentTracks) {
-        auto row                    = *(treeModel->append());
-        row[modelColumns.trackNum]  = track.trackNumber;
-        row[modelColumns.trackName] = track.name;
-        row[modelColumns.trackId]   = track.trackId;
-        row[modelColumns.genre]     = track.genre;
-        row[modelColumns.duration]  = SysUtils::timeStringFromSeconds(
-            static_cast<int>(track.msDuration / 1000));
-        Album album = session.getDatabase()->getAlbumTable().get(track.albumId);
-        row[modelColumns.albumName] = album.name;
-        if (album.artistIds.size() > 0) {
-            Artist artist =
-                session.getDatabase()->getArtistTable().get(album.artistIds[0]);
-            row[modelColumns.artistName] = artist.name;
-        }
+    if (!appendOnly) {
+        treeModel->clear();
+        listedTrackIds.clear();
     }
+    session.getDatabase()->getTrackTable().forEachListingRow(
+        db::TrackTable::TrackType::Regular,
+        [this](const db::TrackListingRow &track) {
+            if (!listedTrackIds.insert(track.trackId).second) {
+                return;
+            }
+            auto row                     = *(treeModel->append());
+            row[modelColumns.trackNum]   = track.trackNumber;
+            row[modelColumns.trackName]  = track.name;
+            row[modelColumns.trackId]    = track.trackId;
+            row[modelColumns.genre]      = track.genre;
+            row[modelColumns.duration]   = SysUtils::timeStringFromSeconds(
+                static_cast<int>(track.msDuration / 1000));
+            row[modelColumns.albumName]  = track.albumName;
+            row[modelColumns.artistName] = track.artistName;
+        });
 }
 
 void MainWindow::updateSelection(const std::string &trackId)
@@ -4,8 +4,10 @@
 #include "player.hpp"
 #include "session.hpp"
 #include "utilities.hpp"
+#include <chrono>
 #include <future>
 #include <gtkmm.h>
+#include <unordered_set>
 
 namespace gmusic
 {
@@ -37,6 +39,8 @@ struct SideTreeViewModelColumns : public Gtk::TreeModel::ColumnRecord {
 struct FilterParams {
     RowType rowType;
     std::string pattern;
+    bool searchActive = false;
+    std::unordered_set<std::string> searchMatches;
 };
 
 struct PlayedTrack {
@@ -68,6 +72,7 @@ struct PlayListModelWrapper {
 
     void start(const Gtk::TreeIter &childIter);
     bool next(PlayListMode mode, Gtk::TreeIter &next);
+    bool peekNext(PlayListMode mode, Gtk::TreeIter &next) const;
     bool prev(PlayListMode mode, Gtk::TreeIter &prev);
 
     Gtk::TreeIter getIter() const
@@ -104,6 +109,20 @@ inline bool PlayListModelWrapper::next(PlayListMode, Gtk::TreeIter &next)
     return false;
 }
 
+inline bool PlayListModelWrapper::peekNext(PlayListMode,
+                                           Gtk::TreeIter &next) const
+{
+    if (!valid) {
+        return false;
+    }
+    auto iter = currentTrackIter;
+    if (++iter == playListModel->children().end()) {
+        return false;
+    }
+    next = playListModel->convert_iter_to_child_iter(iter);
+    return true;
+}
+
 inline bool PlayListModelWrapper::prev(PlayListMode, Gtk::TreeIter &prev)
 {
     if (!valid) {
@@ -147,6 +166,7 @@ class MainWindow : public Gtk::ApplicationWindow, public AudioPlayerDelegate
     std::unique_ptr<LogWindow> logWindow;
 
     Glib::Dispatcher signal_localStorageUpdateCompleted;
+    Glib::Dispatcher signal_syncProgress;
     Glib::Dispatcher signal_loginCompleted;
     Glib::Dispatcher signal_streamUrl;
     Glib::Dispatcher signal_playbackStarted;
@@ -155,17 +175,19 @@ class MainWindow : public Gtk::ApplicationWindow, public AudioPlayerDelegate
 
     void om_streamUrlReceived();
     void on_localDataUpdated();
+    void on_syncProgress();
     void on_windowRealized();
     void on_playbackProgressUpdated();
     void on_playbackStarted();
     void on_playbackFinished();
+    void on_searchChanged();
 
-    std::vector<Track> currentTracks;
     PlayedTrack playedTrack;
     void play(const Gtk::TreeIter &iter);
     void playNext();
     void playPrev();
-    void fillTrackTreeView();
+    void queueNextTrack();
+    void fillTrackTreeView(bool appendOnly);
     void updateSelection(const std::string &trackId);
 
     Glib::RefPtr<Gtk::Builder> builder;
@@ -175,8 +197,11 @@ class MainWindow : public Gtk::ApplicationWindow, public AudioPlayerDelegate
     Gtk::Label *trackLabel             = nullptr;
     Gtk::Label *timeLabel              = nullptr;
     Gtk::Spinner spinner;
+    Gtk::SearchEntry searchEntry;
 
     bool shouldHandleValueChanged = true;
+    std::chrono::steady_clock::time_point lastListingRefresh;
+    std::unordered_set<std::string> listedTrackIds;
     void scaleSetValue(double value);
 
   public:
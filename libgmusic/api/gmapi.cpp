@@ -1,15 +1,17 @@
 #include "api/gmapi.hpp"
+#include "json/json-reader.hpp"
 #include "utilities.hpp"
 
-#include <boost/property_tree/json_parser.hpp>
-#include <boost/property_tree/ptree.hpp>
+#include <algorithm>
 #include <cassert>
+#include <condition_variable>
 #include <future>
+#include <iterator>
 
 namespace gmapi
 {
 
-namespace pt = boost::property_tree;
+using json::JsonReader;
 
 TrackApi::TrackApi(GMApi *baseApi) : baseApi(baseApi) {}
 
@@ -22,16 +24,114 @@ inline static void setupApiSession(HttpSession &session,
     session.setHeaderParam("Authorization", "GoogleLogin auth=" + authToken);
 }
 
-static HttpError checkPayloadForError(const pt::ptree &root)
+static HttpError readError(JsonReader &reader)
 {
-    auto errorCode = root.get_child_optional("error.code");
-    auto errorMsg  = root.get_child_optional("error.message");
-    if (errorCode != boost::none && errorMsg != boost::none) {
-        return HttpError::createFromStatusCode(
-            errorCode.value().get_value<int>(),
-            errorMsg.value().get_value<std::string>());
+    int code = 0;
+    std::string message;
+    reader.readObject([&](boost::string_view key) {
+        if (key == "code") {
+            code = static_cast<int>(reader.readInt());
+        } else if (key == "message") {
+            reader.readString(message);
+        } else {
+            reader.skipValue();
+        }
+    });
+    return HttpError::createFromStatusCode(code, message);
+}
+
+// Walks the members of the payload's root object, turning an "error"
+// member into an exception once the whole payload has been read.
+template <class Handler>
+static void readPayload(const std::string &text, Handler &&onMember)
+{
+    JsonReader reader(text);
+    HttpError error;
+    reader.readObject([&](boost::string_view key) {
+        if (key == "error") {
+            error = readError(reader);
+        } else {
+            onMember(reader, key);
+        }
+    });
+    if (error.code != HttpErrorCode::OK) {
+        throw ApiRequestHttpException(error);
     }
-    return HttpError();
+}
+
+static void readStringArray(JsonReader &reader,
+                            std::vector<std::string> &values)
+{
+    if (reader.readNull()) {
+        return;
+    }
+    reader.readArray([&] { values.push_back(reader.readString()); });
+}
+
+// The service has no batch lookup, so ids are fetched one request each.
+// Up to maxInFlight requests are outstanding on the shared HTTP client at
+// a time, which multiplexes them over one connection. Responses served
+// from the cache complete inline. Ids that fail are logged and left out of
+// the result. If sending throws, the requests already sent are waited for
+// before the exception is passed on.
+template <class T, class MakeRequest, class Parser>
+static std::map<std::string, T> fetchBulk(GMApi *baseApi,
+                                          const std::vector<std::string> &ids,
+                                          size_t maxInFlight,
+                                          MakeRequest makeRequest,
+                                          Parser parse)
+{
+    std::mutex mutex;
+    std::condition_variable done;
+    size_t inFlight = 0;
+    std::map<std::string, T> results;
+    std::exception_ptr error;
+    maxInFlight = std::max<size_t>(maxInFlight, 1);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    for (const auto &id : ids) {
+        done.wait(lock, [&] { return inFlight < maxInFlight; });
+        ++inFlight;
+        lock.unlock();
+
+        try {
+            // The request keeps its slot for as long as a copy of its
+            // handler exists, so the slot is given back even when the
+            // handler is dropped without being called.
+            std::shared_ptr<void> slot(nullptr, [&](void *) {
+                std::lock_guard<std::mutex> lock(mutex);
+                --inFlight;
+                done.notify_all();
+            });
+            auto onResponse = [&, id, slot](const HttpResponse &response) {
+                T item;
+                try {
+                    item = parse(response);
+                } catch (const std::exception &e) {
+                    ERRLOG << id << ": " << e.what() << std::endl;
+                    return;
+                } catch (...) {
+                    ERRLOG << id << ": unknown error" << std::endl;
+                    return;
+                }
+                std::lock_guard<std::mutex> lock(mutex);
+                results.emplace(id, std::move(item));
+            };
+            baseApi->sendCached(makeRequest(baseApi, id), onResponse);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        lock.lock();
+        if (error) {
+            break;
+        }
+    }
+    // The handlers refer to this frame, so none may be left when it ends.
+    done.wait(lock, [&] { return inFlight == 0; });
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    return results;
 }
 
 ApiRequestHttpException::ApiRequestHttpException(const HttpError &error)
@@ -39,7 +139,11 @@ ApiRequestHttpException::ApiRequestHttpException(const HttpError &error)
 {
 }
 
-GMApi::GMApi() : dmApi{this}, trackApi{this}, albumApi{this}, artistApi{this} {}
+GMApi::GMApi()
+    : dmApi{this}, loginApi{this}, trackApi{this}, albumApi{this},
+      artistApi{this}
+{
+}
 
 void GMApi::updateCredentials(const AuthCredentials &credentials)
 {
@@ -58,9 +162,48 @@ void GMApi::prepareRequest(HttpRequest &request)
     request.addParameter("tier", "fr");
 }
 
+void GMApi::sendAsync(HttpRequest request,
+                      const HttpClient::CompletionHandler &handler)
+{
+    request.addHeader("User-Agent", "gm-player/1.0");
+    request.addHeader("Authorization",
+                      "GoogleLogin auth=" + credentials.authToken);
+    client.send(request, handler);
+}
+
+void GMApi::sendCached(HttpRequest request,
+                       const HttpClient::CompletionHandler &handler)
+{
+    if (responseCache == nullptr) {
+        sendAsync(request, handler);
+        return;
+    }
+    if (auto cached = responseCache->lookup(request)) {
+        handler(*cached);
+        return;
+    }
+    auto cache = responseCache;
+    sendAsync(request, [cache, request, handler](const HttpResponse &response) {
+        handler(cache->update(request, response));
+    });
+}
+
+HttpResponse GMApi::makeCachedRequest(HttpRequest request)
+{
+    if (responseCache == nullptr) {
+        return getApiSession().makeRequest(request);
+    }
+    if (auto cached = responseCache->lookup(request)) {
+        return *cached;
+    }
+    return responseCache->update(request,
+                                 getApiSession().makeRequest(request));
+}
+
 HttpSession GMApi::getApiSession()
 {
     HttpSession session;
+    session.setShare(&share);
     setupApiSession(session, credentials.authToken);
     return session;
 }
@@ -85,12 +228,7 @@ std::future<void> GMApi::loginAsync(const std::string &email,
         std::launch::async, &GMApi::login, this, email, passwd, deviceId);
 }
 
-std::future<Album> AlbumApi::getAlbumAsync(const std::string &id)
-{
-    return std::async(std::launch::async, &AlbumApi::getAlbum, this, id);
-}
-
-Album AlbumApi::getAlbum(const std::string &id)
+static HttpRequest makeAlbumRequest(GMApi *baseApi, const std::string &id)
 {
     static std::string targetUrl = baseApi->getBaseUrl() + "fetchalbum";
 
@@ -100,51 +238,64 @@ Album AlbumApi::getAlbum(const std::string &id)
     request.addParameter("nid", id);
     request.addParameter("include-tracks", "false");
     baseApi->prepareRequest(request);
+    return request;
+}
 
-    HttpSession apiSession = baseApi->getApiSession();
-    HttpResponse response  = apiSession.makeRequest(request);
-    //    HttpResponse response =
-    //    baseApi->getApiSession()->makeRequest(request);
-
-    //    return baseApi->performAsyncRequest<Album>(request, [=](const
-    //    HttpResponse &response){
+static Album parseAlbum(const HttpResponse &response)
+{
     if (response.error.code != HttpErrorCode::OK) {
         throw ApiRequestException(response.error.message);
     }
 
-    pt::ptree root;
-    std::istringstream istr(response.text);
-    pt::read_json(istr, root);
-
-    auto resultError = checkPayloadForError(root);
-    if (resultError.code != HttpErrorCode::OK) {
-        throw ApiRequestHttpException(resultError);
-    }
-
     Album album;
-
-    album.albumId = root.get<std::string>("albumId");
-    album.name =
-        root.get_optional<std::string>("name").value_or("Untitled album");
-    album.artUrl = root.get_optional<std::string>("albumArtRef").value_or("");
-    auto &artistIds = root.get_child("artistId");
-    for (const auto &artistId : artistIds) {
-        album.artistIds.push_back(artistId.second.get_value<std::string>());
+    album.name = "Untitled album";
+    album.year = 1970;
+    auto readMember = [&album](JsonReader &reader, boost::string_view key) {
+        if (key == "albumId") {
+            reader.readString(album.albumId);
+        } else if (key == "name") {
+            reader.readString(album.name);
+        } else if (key == "albumArtRef") {
+            reader.readString(album.artUrl);
+        } else if (key == "artistId") {
+            readStringArray(reader, album.artistIds);
+        } else if (key == "description") {
+            reader.readString(album.descr);
+        } else if (key == "year") {
+            album.year = static_cast<int>(reader.readInt());
+        } else {
+            reader.skipValue();
+        }
+    };
+    readPayload(response.text, readMember);
+    if (album.albumId.empty()) {
+        throw ApiRequestException("album payload without albumId");
     }
 
-    album.descr = root.get_optional<std::string>("description").value_or("");
-    album.year  = root.get_optional<int>("year").value_or(1970);
-
     return album;
-    //    });
 }
 
-std::future<Artist> ArtistApi::getArtistAsync(const std::string &id)
+std::future<Album> AlbumApi::getAlbumAsync(const std::string &id)
 {
-    return std::async(std::launch::async, &ArtistApi::getArtist, this, id);
+    return baseApi->performAsyncRequest<Album>(
+        makeAlbumRequest(baseApi, id), parseAlbum, true);
 }
 
-Artist ArtistApi::getArtist(const std::string &id)
+Album AlbumApi::getAlbum(const std::string &id)
+{
+    auto request = makeAlbumRequest(baseApi, id);
+    return parseAlbum(baseApi->makeCachedRequest(request));
+}
+
+std::map<std::string, Album>
+AlbumApi::getAlbums(const std::vector<std::string> &albumIds,
+                    size_t maxInFlight)
+{
+    return fetchBulk<Album>(
+        baseApi, albumIds, maxInFlight, makeAlbumRequest, parseAlbum);
+}
+
+static HttpRequest makeArtistRequest(GMApi *baseApi, const std::string &id)
 {
     static std::string targetUrl = baseApi->getBaseUrl() + "fetchartist";
 
@@ -154,162 +305,356 @@ Artist ArtistApi::getArtist(const std::string &id)
     request.addParameter("nid", id);
     request.addParameter("include-albums", "true");
     baseApi->prepareRequest(request);
+    return request;
+}
 
-    HttpSession apiSession = baseApi->getApiSession();
-    HttpResponse response  = apiSession.makeRequest(request);
+static Artist parseArtist(const HttpResponse &response)
+{
     if (response.error.code != HttpErrorCode::OK) {
         throw ApiRequestException(response.error.message);
     }
 
-    pt::ptree root;
-    std::istringstream istr(response.text);
-    pt::read_json(istr, root);
-
-    auto resultError = checkPayloadForError(root);
-    if (resultError.code != HttpErrorCode::OK) {
-        throw ApiRequestHttpException(resultError);
+    Artist artist;
+    artist.name = "Unknown artist";
+    auto readMember = [&artist](JsonReader &reader, boost::string_view key) {
+        if (key == "artistId") {
+            reader.readString(artist.artistId);
+        } else if (key == "name") {
+            reader.readString(artist.name);
+        } else if (key == "artistBio") {
+            reader.readString(artist.bio);
+        } else if (key == "artistArtRef") {
+            reader.readString(artist.artUrl);
+        } else {
+            reader.skipValue();
+        }
+    };
+    readPayload(response.text, readMember);
+    if (artist.artistId.empty()) {
+        throw ApiRequestException("artist payload without artistId");
     }
 
-    //        STD_LOG << root << std::endl;
-    Artist artist;
+    return artist;
+}
 
-    artist.name =
-        root.get_optional<std::string>("name").value_or("Unknown artist");
-    artist.bio    = root.get_optional<std::string>("artistBio").value_or("");
-    artist.artUrl = root.get_optional<std::string>("artistArtRef").value_or("");
-    artist.artistId = root.get<std::string>("artistId");
+std::future<Artist> ArtistApi::getArtistAsync(const std::string &id)
+{
+    return baseApi->performAsyncRequest<Artist>(
+        makeArtistRequest(baseApi, id), parseArtist, true);
+}
 
-    return artist;
+Artist ArtistApi::getArtist(const std::string &id)
+{
+    auto request = makeArtistRequest(baseApi, id);
+    return parseArtist(baseApi->makeCachedRequest(request));
 }
 
-DeviceList DMApi::getRegisteredDevices()
+std::map<std::string, Artist>
+ArtistApi::getArtists(const std::vector<std::string> &artistIds,
+                      size_t maxInFlight)
+{
+    return fetchBulk<Artist>(
+        baseApi, artistIds, maxInFlight, makeArtistRequest, parseArtist);
+}
+
+static HttpRequest makeDevicesRequest(GMApi *baseApi)
 {
     static std::string requestUrl =
         baseApi->getBaseUrl() + "devicemanagementinfo";
 
     HttpRequest request{HttpMethod::GET, requestUrl};
     baseApi->prepareRequest(request);
+    return request;
+}
 
-    HttpSession apiSession = baseApi->getApiSession();
-    HttpResponse response  = apiSession.makeRequest(request);
-    //    auto response = baseApi->getApiSession()->makeRequest(request);
-
-    //    return baseApi->performAsyncRequest<DeviceList>(request, [=](const
-    //    HttpResponse &response){
+static DeviceList parseDevices(const HttpResponse &response)
+{
     if (response.error.code != HttpErrorCode::OK) {
         throw ApiRequestException(response.error.message);
     }
 
     std::vector<Device> devices;
-    pt::ptree root;
-    std::istringstream istr(response.text);
-    pt::read_json(istr, root);
+    auto readDevice = [&devices](JsonReader &reader) {
+        Device device;
+        device.friendlyName   = "Unknown device";
+        device.lastAccessTime = 0;
+        reader.readObject([&](boost::string_view key) {
+            if (key == "id") {
+                reader.readString(device.deviceId);
+            } else if (key == "friendlyName") {
+                reader.readString(device.friendlyName);
+            } else if (key == "type") {
+                reader.readString(device.deviceType);
+            } else if (key == "lastAccessedTimeMs") {
+                device.lastAccessTime = reader.readUnsigned();
+            } else {
+                reader.skipValue();
+            }
+        });
+        devices.push_back(std::move(device));
+    };
+    auto readMember = [&](JsonReader &reader, boost::string_view key) {
+        if (key != "data") {
+            reader.skipValue();
+            return;
+        }
+        reader.readObject([&](boost::string_view dataKey) {
+            if (dataKey == "items") {
+                reader.readArray([&] { readDevice(reader); });
+            } else {
+                reader.skipValue();
+            }
+        });
+    };
+    readPayload(response.text, readMember);
+    return devices;
+}
 
-    auto resultError = checkPayloadForError(root);
-    if (resultError.code != HttpErrorCode::OK) {
-        throw ApiRequestHttpException(resultError);
-    }
-    const auto &items = root.get_child("data.items");
+DeviceList DMApi::getRegisteredDevices()
+{
+    HttpSession apiSession = baseApi->getApiSession();
+    return parseDevices(apiSession.makeRequest(makeDevicesRequest(baseApi)));
+}
 
-    for (const auto &deviceItem : items) {
+std::future<DeviceList> DMApi::getRegisteredDevicesAsync()
+{
+    return baseApi->performAsyncRequest<DeviceList>(
+        makeDevicesRequest(baseApi), parseDevices);
+}
 
-        Device device;
-        device.deviceId = deviceItem.second.get<std::string>("id");
-        device.friendlyName =
-            deviceItem.second.get_optional<std::string>("friendlyName")
-                .value_or("Unknown device");
-        device.deviceType =
-            deviceItem.second.get_optional<std::string>("type").value_or("");
-        auto lastAccessTime =
-            deviceItem.second.get_optional<std::string>("lastAccessedTimeMs")
-                .value_or("0");
-        device.lastAccessTime =
-            StringUtils::unsignedLongFromString(lastAccessTime);
+static Track makeDefaultTrack()
+{
+    Track track;
+    track.name        = "Untitled track";
+    track.trackType   = "8";
+    track.msDuration  = 0;
+    track.trackNumber = 1;
+    track.year        = 1970;
+    track.size        = 0;
+    return track;
+}
 
-        devices.push_back(std::move(device));
+// Reads key into track, returning false for keys that are not track fields.
+static bool readTrackMember(JsonReader &reader,
+                            boost::string_view key,
+                            Track &track)
+{
+    if (key == "id") {
+        reader.readString(track.trackId);
+    } else if (key == "title") {
+        reader.readString(track.name);
+    } else if (key == "albumId") {
+        reader.readString(track.albumId);
+    } else if (key == "genre") {
+        reader.readString(track.genre);
+    } else if (key == "durationMillis") {
+        track.msDuration = reader.readUnsigned();
+    } else if (key == "trackNumber") {
+        track.trackNumber = static_cast<int>(reader.readInt());
+    } else if (key == "year") {
+        track.year = static_cast<int>(reader.readInt());
+    } else if (key == "trackType") {
+        reader.readString(track.trackType);
+    } else if (key == "estimatedSize") {
+        track.size = reader.readUnsigned();
+    } else if (key == "artistId") {
+        readStringArray(reader, track.artistIds);
+    } else {
+        return false;
     }
-    return devices;
-    //    });
+    return true;
 }
 
-std::future<DeviceList> DMApi::getRegisteredDevicesAsync()
+static void readTrackItem(JsonReader &reader, TrackFeedPage &page)
 {
-    return std::async(std::launch::async, &DMApi::getRegisteredDevices, this);
+    Track track  = makeDefaultTrack();
+    bool deleted = false;
+
+    reader.readObject([&](boost::string_view key) {
+        if (readTrackMember(reader, key, track)) {
+            return;
+        }
+        if (key == "deleted") {
+            deleted = reader.readBool();
+        } else if (key == "lastModifiedTimestamp") {
+            page.lastModifiedUs =
+                std::max(page.lastModifiedUs, reader.readUnsigned());
+        } else {
+            reader.skipValue();
+        }
+    });
+
+    if (track.trackId.empty()) {
+        throw ApiRequestException("trackfeed item without id");
+    }
+    if (deleted) {
+        page.deletedTrackIds.push_back(std::move(track.trackId));
+    } else {
+        page.tracks.push_back(std::move(track));
+    }
 }
 
-std::future<TrackList> TrackApi::getTrackListAsync()
+// Quotes value as a JSON string.
+static std::string jsonString(const std::string &value)
 {
-    return std::async(std::launch::async, &TrackApi::getTrackList, this);
+    static const char hex[] = "0123456789abcdef";
+    std::string quoted      = "\"";
+    for (char c : value) {
+        auto byte = static_cast<unsigned char>(c);
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+            quoted += c;
+        } else if (byte < 0x20) {
+            quoted += "\\u00";
+            quoted += hex[byte >> 4];
+            quoted += hex[byte & 0xf];
+        } else {
+            quoted += c;
+        }
+    }
+    return quoted + '"';
 }
 
-TrackList TrackApi::getTrackList()
+static HttpRequest makeTrackFeedRequest(GMApi *baseApi,
+                                        const std::string &startToken,
+                                        uint64_t updatedMinUs,
+                                        size_t maxResults)
 {
     static std::string targetUrl = baseApi->getBaseUrl() + "trackfeed";
 
     HttpRequest request{HttpMethod::POST, targetUrl};
     baseApi->prepareRequest(request);
+    if (updatedMinUs > 0) {
+        request.addParameter("updated-min", std::to_string(updatedMinUs));
+    }
 
-    HttpSession apiSession = baseApi->getApiSession();
-    HttpResponse response  = apiSession.makeRequest(request);
-
-    //    HttpResponse response =
-    //    baseApi->getApiSession()->makeRequest(request);
+    std::string body = "{\"max-results\": " + std::to_string(maxResults);
+    if (!startToken.empty()) {
+        body += ", \"start-token\": " + jsonString(startToken);
+    }
+    request.setBody(body + "}");
+    request.addHeader("Content-Type", "application/json");
+    return request;
+}
 
-    //    return baseApi->performAsyncRequest<TrackList>(request, [=](const
-    //    HttpResponse &response){
+static TrackFeedPage parseTrackFeedPage(const HttpResponse &response)
+{
     if (response.error.code != HttpErrorCode::OK) {
         throw ApiRequestException(response.error.message);
     }
 
-    pt::ptree root;
-    std::istringstream istr(response.text);
-    pt::read_json(istr, root);
+    TrackFeedPage page;
+    auto readMember = [&page](JsonReader &reader, boost::string_view key) {
+        if (key == "nextPageToken") {
+            reader.readString(page.nextPageToken);
+        } else if (key == "data") {
+            reader.readObject([&](boost::string_view dataKey) {
+                if (dataKey == "items") {
+                    reader.readArray([&] { readTrackItem(reader, page); });
+                } else {
+                    reader.skipValue();
+                }
+            });
+        } else {
+            reader.skipValue();
+        }
+    };
+    readPayload(response.text, readMember);
+    return page;
+}
 
-    const auto &resultError = checkPayloadForError(root);
-    if (resultError.code != HttpErrorCode::OK) {
-        throw ApiRequestHttpException(resultError);
-    }
+TrackFeedPage TrackApi::getTrackFeedPage(const std::string &startToken,
+                                         uint64_t updatedMinUs,
+                                         size_t maxResults)
+{
+    auto request =
+        makeTrackFeedRequest(baseApi, startToken, updatedMinUs, maxResults);
+    HttpSession apiSession = baseApi->getApiSession();
+    return parseTrackFeedPage(apiSession.makeRequest(request));
+}
 
-    const auto &items = root.get_child("data.items");
+TrackList TrackApi::getTrackList()
+{
+    TrackList trackList;
+    std::string pageToken;
+    do {
+        auto page = getTrackFeedPage(pageToken, 0);
+        std::move(page.tracks.begin(),
+                  page.tracks.end(),
+                  std::back_inserter(trackList));
+        pageToken = page.nextPageToken;
+    } while (!pageToken.empty());
+
+    STDLOG << "Tracks count: " << trackList.size() << std::endl;
+    return trackList;
+}
 
+struct TrackListFetch {
+    std::promise<TrackList> promise;
     TrackList trackList;
-    STDLOG << "Tracks count: " << items.size() << std::endl;
-    for (const auto &item : items) {
-        Track track;
-
-        track.name = item.second.get_optional<std::string>("title").value_or(
-            "Untitled track");
-        track.trackId = item.second.get<std::string>("id");
-
-        track.albumId =
-            item.second.get_optional<std::string>("albumId").value_or("");
-        track.genre =
-            item.second.get_optional<std::string>("genre").value_or("");
-        auto duration = item.second.get_optional<std::string>("durationMillis")
-                            .value_or("0");
-        track.msDuration = StringUtils::unsignedLongFromString(duration);
-        track.trackNumber =
-            item.second.get_optional<int>("trackNumber").value_or(1);
-        track.year = item.second.get_optional<int>("year").value_or(1970);
-        track.trackType =
-            item.second.get_optional<std::string>("trackType").value_or("8");
-        auto trackSize = item.second.get_optional<std::string>("estimatedSize")
-                             .value_or("0");
-        track.size = StringUtils::unsignedLongFromString(trackSize);
-
-        const auto &artistIds = item.second.get_child_optional("artistId");
-        if (artistIds) {
-            auto &artistIdsArray = artistIds.value();
-            for (const auto &artistId : artistIdsArray) {
-                track.artistIds.push_back(
-                    artistId.second.get_value<std::string>());
+};
+
+// Each page is requested from the completion of the previous one, so the
+// whole listing is fetched without holding a thread.
+static void fetchTrackListPage(GMApi *baseApi,
+                               std::shared_ptr<TrackListFetch> fetch,
+                               const std::string &pageToken)
+{
+    auto request = makeTrackFeedRequest(
+        baseApi, pageToken, 0, TrackApi::defaultPageSize);
+    baseApi->sendAsync(request, [=](const HttpResponse &response) {
+        try {
+            auto page = parseTrackFeedPage(response);
+            std::move(page.tracks.begin(),
+                      page.tracks.end(),
+                      std::back_inserter(fetch->trackList));
+            if (!page.nextPageToken.empty()) {
+                fetchTrackListPage(baseApi, fetch, page.nextPageToken);
+                return;
             }
+            STDLOG << "Tracks count: " << fetch->trackList.size()
+                   << std::endl;
+            fetch->promise.set_value(std::move(fetch->trackList));
+        } catch (...) {
+            fetch->promise.set_exception(std::current_exception());
         }
+    });
+}
+
+std::future<TrackList> TrackApi::getTrackListAsync()
+{
+    auto fetch  = std::make_shared<TrackListFetch>();
+    auto future = fetch->promise.get_future();
+    fetchTrackListPage(baseApi, fetch, std::string());
+    return future;
+}
+
+Track TrackApi::getTrack(const std::string &trackId)
+{
+    static std::string targetUrl = baseApi->getBaseUrl() + "fetchtrack";
+
+    assert(!trackId.empty());
 
-        trackList.push_back(std::move(track));
+    HttpRequest request{HttpMethod::GET, targetUrl};
+    request.addParameter("nid", trackId);
+    baseApi->prepareRequest(request);
+    auto response = baseApi->getApiSession().makeRequest(request);
+    if (response.error.code != HttpErrorCode::OK) {
+        throw ApiRequestException(response.error.message);
     }
-    return trackList;
-    //    });
+
+    Track track = makeDefaultTrack();
+    readPayload(response.text, [&track](JsonReader &reader,
+                                        boost::string_view key) {
+        if (!readTrackMember(reader, key, track)) {
+            reader.skipValue();
+        }
+    });
+    if (track.trackId.empty()) {
+        // Store tracks are answered without their library id.
+        track.trackId = trackId;
+    }
+    return track;
 }
 
 std::string TrackApi::getStreamUrl(const std::string &trackId)
@@ -332,6 +677,7 @@ std::string TrackApi::getStreamUrl(const std::string &trackId)
     //    baseApi->prepareRequest(request);
 
     HttpSession session;
+    session.setShare(baseApi->getShare());
     session.setHeaderParam("Authorization",
                            "GoogleLogin auth=" +
                                baseApi->getCredentials().authToken);
@@ -346,15 +692,18 @@ std::string TrackApi::getStreamUrl(const std::string &trackId)
     return std::string();
 }
 
-static HttpResponse performAuthRequest(const std::vector<KVPair> &body);
+static HttpResponse performAuthRequest(const std::vector<KVPair> &body,
+                                       HttpShare *share);
 static bool parseResponseText(const std::string &responseText,
                               std::map<std::string, std::string> &result);
 static std::string getMasterToken(const std::string &login,
                                   const std::string &passwd,
-                                  const std::string &deviceId);
+                                  const std::string &deviceId,
+                                  HttpShare *share);
 static std::string getAuthToken(const std::string &login,
                                 const std::string &masterToken,
-                                const std::string &deviceId);
+                                const std::string &deviceId,
+                                HttpShare *share);
 
 AuthCredentials LoginApi::login(const std::string &email,
                                 const std::string &passwd,
@@ -364,9 +713,10 @@ AuthCredentials LoginApi::login(const std::string &email,
     std::string deviceId = androidId;
     std::string encryptedLogPasswd =
         CryptoUtils::encryptLoginAndPasswd(email, passwd);
-    std::string masterToken =
-        getMasterToken(email, encryptedLogPasswd, deviceId);
-    std::string authToken = getAuthToken(email, masterToken, deviceId);
+    std::string masterToken = getMasterToken(
+        email, encryptedLogPasswd, deviceId, baseApi->getShare());
+    std::string authToken =
+        getAuthToken(email, masterToken, deviceId, baseApi->getShare());
     return AuthCredentials{authToken, email, androidId};
     //    });
 }
@@ -381,7 +731,8 @@ std::future<AuthCredentials> LoginApi::loginAsync(const std::string &email,
 
 std::string getMasterToken(const std::string &login,
                            const std::string &passwd,
-                           const std::string &deviceId)
+                           const std::string &deviceId,
+                           HttpShare *share)
 {
     std::vector<KVPair> body;
     body.emplace_back("accountType", "HOSTED_OR_GOOGLE");
@@ -397,7 +748,7 @@ std::string getMasterToken(const std::string &login,
     body.emplace_back("EncryptedPasswd", passwd);
     body.emplace_back("androidId", deviceId);
 
-    HttpResponse response = performAuthRequest(body);
+    HttpResponse response = performAuthRequest(body, share);
 
     if (response.error.code != HttpErrorCode::OK) {
         throw std::runtime_error(response.error.message);
@@ -418,7 +769,8 @@ std::string getMasterToken(const std::string &login,
 
 std::string getAuthToken(const std::string &login,
                          const std::string &masterToken,
-                         const std::string &deviceId)
+                         const std::string &deviceId,
+                         HttpShare *share)
 {
     std::vector<KVPair> body;
     body.emplace_back("accountType", "HOSTED_OR_GOOGLE");
@@ -435,7 +787,7 @@ std::string getAuthToken(const std::string &login,
     body.emplace_back("EncryptedPasswd", masterToken);
     body.emplace_back("androidId", deviceId);
 
-    HttpResponse response = performAuthRequest(body);
+    HttpResponse response = performAuthRequest(body, share);
 
     if (response.error.code != HttpErrorCode::OK) {
         throw std::runtime_error(response.error.message);
@@ -454,12 +806,13 @@ std::string getAuthToken(const std::string &login,
     return token->second;
 }
 
-static HttpResponse performAuthRequest(const std::vector<KVPair> &body)
+static HttpResponse performAuthRequest(const std::vector<KVPair> &body,
+                                       HttpShare *share)
 {
     HttpRequest request{HttpMethod::POST,
                         "https://android.clients.google.com/auth"};
     request.setBody(body);
-    return HttpSession::performRequest(request);
+    return HttpSession::performRequest(request, share);
 }
 
 bool parseResponseText(const std::string &responseText,
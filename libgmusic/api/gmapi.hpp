@@ -3,8 +3,12 @@
 
 #include <string>
 #include <future>
+#include <map>
 //#include <boost/thread/future.hpp>
 #include "http/httpsession.hpp"
+#include "http/http-client.hpp"
+#include "http/http-share.hpp"
+#include "http/response-cache.hpp"
 #include "model/model.hpp"
 #include "operation-queue.hpp"
 
@@ -30,8 +34,11 @@ struct AuthCredentials {
 class LoginApi {
 public:
     using LoginCallback = std::function<void(AuthCredentials)>;
+    LoginApi(GMApi *baseApi): baseApi { baseApi } {}
     AuthCredentials login(const std::string &email, const std::string &passwd, const std::string &deviceId = std::string());
     std::future<AuthCredentials> loginAsync(const std::string &email, const std::string &passwd, const std::string &deviceId = std::string());
+private:
+    GMApi *baseApi;
 };
 
 class AlbumApi {
@@ -40,6 +47,7 @@ public:
     AlbumApi(GMApi *baseApi): baseApi { baseApi } {}
     Album getAlbum(const std::string &albumId);
     std::future<Album> getAlbumAsync(const std::string &albumId);
+    std::map<std::string, Album> getAlbums(const std::vector<std::string> &albumIds, size_t maxInFlight);
 private:
     GMApi *baseApi;
 };
@@ -49,6 +57,7 @@ public:
     ArtistApi(GMApi *baseApi): baseApi { baseApi } {}
     Artist getArtist(const std::string &artistId);
     std::future<Artist> getArtistAsync(const std::string &id);
+    std::map<std::string, Artist> getArtists(const std::vector<std::string> &artistIds, size_t maxInFlight);
 private:
     GMApi *baseApi;
 };
@@ -65,13 +74,24 @@ private:
 };
 
 using TrackList = std::vector<Track>;
+
+struct TrackFeedPage {
+    TrackList tracks;
+    std::vector<std::string> deletedTrackIds;
+    std::string nextPageToken;
+    uint64_t lastModifiedUs = 0;
+};
+
 class TrackApi {
 public:
     using TrackListCallback = std::function<void(TrackList)>;
+    static const size_t defaultPageSize = 1000;
 
     TrackApi(GMApi *baseApi);
     TrackList getTrackList();
+    TrackFeedPage getTrackFeedPage(const std::string &startToken, uint64_t updatedMinUs, size_t maxResults = defaultPageSize);
     std::future<TrackList> getTrackListAsync();
+    Track getTrack(const std::string &trackId);
     std::string getStreamUrl(const std::string &trackId);
 private:
     GMApi *baseApi;
@@ -85,6 +105,12 @@ public:
 //    HttpSession *getApiSession();
     HttpSession getApiSession();
     void prepareRequest(HttpRequest &request);
+    void sendAsync(HttpRequest request, const HttpClient::CompletionHandler &handler);
+    void sendCached(HttpRequest request, const HttpClient::CompletionHandler &handler);
+    HttpResponse makeCachedRequest(HttpRequest request);
+    template <class T, class Parser>
+    std::future<T> performAsyncRequest(const HttpRequest &request, Parser parser, bool useCache = false);
+    void setResponseCache(ResponseCache *cache) { responseCache = cache; }
     std::string getBaseUrl() const;
     void login(const std::string &email, const std::string &passwd, const std::string &deviceId);
     std::future<void> loginAsync(const std::string &email, const std::string &passwd, const std::string &deviceId = std::string());
@@ -95,12 +121,19 @@ public:
     AlbumApi &getAlbumApi() { return albumApi; }
     ArtistApi &getArtistApi() { return artistApi; }
 
+    HttpShare *getShare() { return &share; }
+    HttpShareStats getShareStats() const { return share.getStats(); }
+    HttpClientStats getClientStats() const { return client.getStats(); }
+
     bool isLoggedIn() { return !credentials.authToken.empty(); }
 
     AuthCredentials &getCredentials() { return credentials; }
     void clearCredentials() { credentials = AuthCredentials(); }
 private:
     std::mutex mutex;
+    HttpShare share;
+    HttpClient client;
+    ResponseCache *responseCache = nullptr;
     DMApi dmApi;
     LoginApi loginApi;
     TrackApi trackApi;
@@ -111,6 +144,28 @@ private:
     AuthCredentials credentials;
 };
 
+// Runs the request on the shared HTTP client; the parser is called on the
+// client's I/O thread and its result or exception completes the future.
+template <class T, class Parser>
+std::future<T> GMApi::performAsyncRequest(const HttpRequest &request, Parser parser, bool useCache)
+{
+    auto promise = std::make_shared<std::promise<T>>();
+    auto future = promise->get_future();
+    auto complete = [promise, parser](const HttpResponse &response) {
+        try {
+            promise->set_value(parser(response));
+        } catch (...) {
+            promise->set_exception(std::current_exception());
+        }
+    };
+    if (useCache) {
+        sendCached(request, complete);
+    } else {
+        sendAsync(request, complete);
+    }
+    return future;
+}
+
 }
 
 #endif //GMAPI_HPP_
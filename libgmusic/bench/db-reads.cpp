@@ -0,0 +1,145 @@
+// Measures how long UI reads take while a sync writes the library: with the
+// default profile (WAL and snapshot reads) and with the rollback journal
+// and reader/writer lock the database used before.
+//
+// Usage: bench-db-reads [tracks]
+
+#include "db/database.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <boost/filesystem.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+using namespace gmusic;
+using Clock = std::chrono::steady_clock;
+
+static const size_t batchTracks = 250;
+static const size_t preloaded   = 1000;
+
+static Track makeTrack(size_t i)
+{
+    Track track;
+    track.trackId     = "T" + std::to_string(i);
+    track.albumId     = "L" + std::to_string(i / 12);
+    track.artistIds   = {"A" + std::to_string(i / 120)};
+    track.name        = "Track " + std::to_string(i);
+    track.genre       = i % 2 ? "Rock" : "Jazz";
+    track.trackType   = "8";
+    track.msDuration  = 200000;
+    track.trackNumber = static_cast<int>(i % 12) + 1;
+    track.year        = 2000;
+    track.size        = 0;
+    return track;
+}
+
+static void insertRange(db::Database &db, size_t from, size_t to)
+{
+    std::vector<Artist> artists;
+    std::vector<Album> albums;
+    std::vector<Track> tracks;
+    for (size_t i = from; i < to; ++i) {
+        tracks.push_back(makeTrack(i));
+        if (i % 12 == 0) {
+            Album album;
+            album.albumId   = tracks.back().albumId;
+            album.name      = "Album " + std::to_string(i / 12);
+            album.artistIds = tracks.back().artistIds;
+            album.year      = 2000;
+            albums.push_back(album);
+        }
+        if (i % 120 == 0) {
+            Artist artist;
+            artist.artistId = tracks.back().artistIds[0];
+            artist.name     = "Artist " + std::to_string(i / 120);
+            artists.push_back(artist);
+        }
+    }
+    db.insertBatch(artists, albums, tracks);
+}
+
+static double percentile(std::vector<double> &values, double p)
+{
+    if (values.empty()) {
+        return 0;
+    }
+    auto at = static_cast<size_t>(p * (values.size() - 1));
+    std::nth_element(values.begin(), values.begin() + at, values.end());
+    return values[at];
+}
+
+static void run(const char *name,
+                const db::StorageProfile &profile,
+                size_t trackCount)
+{
+    namespace fs = boost::filesystem;
+    auto dir     = fs::temp_directory_path() / fs::unique_path();
+    fs::create_directories(dir);
+
+    {
+        db::Database db((dir / "bench.db").string(), profile);
+        insertRange(db, 0, preloaded);
+
+        std::atomic_bool syncing{true};
+        std::vector<double> getUs, searchUs;
+        std::thread reader([&] {
+            size_t i = 0;
+            while (syncing) {
+                auto start = Clock::now();
+                db.getTrackTable().get("T" + std::to_string(i++ % preloaded));
+                auto middle = Clock::now();
+                db.getTrackTable().search("track " + std::to_string(i % 100),
+                                          50);
+                auto end = Clock::now();
+                getUs.push_back(
+                    std::chrono::duration<double, std::micro>(middle - start)
+                        .count());
+                searchUs.push_back(
+                    std::chrono::duration<double, std::micro>(end - middle)
+                        .count());
+            }
+        });
+
+        auto start = Clock::now();
+        for (size_t from = preloaded; from < trackCount;
+             from += batchTracks) {
+            insertRange(db, from, std::min(trackCount, from + batchTracks));
+        }
+        double syncMs =
+            std::chrono::duration<double, std::milli>(Clock::now() - start)
+                .count();
+        syncing = false;
+        reader.join();
+
+        std::cout << std::fixed << std::setprecision(1) << name
+                  << ": sync of " << trackCount << " tracks " << syncMs
+                  << " ms, " << getUs.size() << " UI reads during it"
+                  << std::endl;
+        std::cout << "  get:    p50 " << percentile(getUs, 0.5) << " us, p99 "
+                  << percentile(getUs, 0.99) << " us, max "
+                  << percentile(getUs, 1) << " us" << std::endl;
+        std::cout << "  search: p50 " << percentile(searchUs, 0.5)
+                  << " us, p99 " << percentile(searchUs, 0.99) << " us, max "
+                  << percentile(searchUs, 1) << " us" << std::endl;
+    }
+    fs::remove_all(dir);
+}
+
+int main(int argc, char *argv[])
+{
+    size_t trackCount = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 50000;
+
+    run("WAL, snapshot reads", db::StorageProfile(), trackCount);
+
+    db::StorageProfile rollback;
+    rollback.journalMode = "DELETE";
+    rollback.synchronous = "FULL";
+    rollback.mmapSize    = 0;
+    rollback.cacheSize   = -2000;
+    run("rollback journal", rollback, trackCount);
+    return 0;
+}
@@ -0,0 +1,144 @@
+// Plays two MP3 files back to back through AudioPlayer, the second queued
+// with queueNext() while the first plays, on libao's "null" driver. Checks
+// that the output got exactly the samples of both tracks, decoded apart:
+// nothing dropped or doubled at the switch and no silence put between them,
+// on one device. The player's own log gives the time the decoder took to
+// switch and how much audio was still buffered when it did.
+//
+// The null driver does not pace playback, so this runs faster than real
+// time and the underrun count it reports means nothing.
+//
+// Usage: bench-gapless-gap first.mp3 second.mp3
+
+#include "player.hpp"
+
+#include <atomic>
+#include <boost/filesystem.hpp>
+#include <chrono>
+#include <iostream>
+#include <mpg123.h>
+#include <thread>
+
+using namespace gmusic;
+using Clock = std::chrono::steady_clock;
+namespace fs = boost::filesystem;
+
+// Decodes the file the way the player does and returns the PCM size.
+static uint64_t decodedBytes(const std::string &path, long &rate, int &channels)
+{
+    mpg123_handle *decoder = mpg123_new(nullptr, nullptr);
+    mpg123_param(decoder, MPG123_ADD_FLAGS, MPG123_GAPLESS, 0);
+    const long *rates;
+    size_t rateCount;
+    mpg123_rates(&rates, &rateCount);
+    mpg123_format_none(decoder);
+    for (size_t i = 0; i < rateCount; ++i) {
+        mpg123_format(decoder,
+                      rates[i],
+                      MPG123_MONO | MPG123_STEREO,
+                      MPG123_ENC_SIGNED_16);
+    }
+
+    uint64_t total = 0;
+    if (mpg123_open(decoder, path.c_str()) == MPG123_OK) {
+        int encoding;
+        mpg123_getformat(decoder, &rate, &channels, &encoding);
+        std::vector<unsigned char> buffer(mpg123_outblock(decoder));
+        size_t done = 0;
+        int err     = MPG123_OK;
+        while (err == MPG123_OK || err == MPG123_NEW_FORMAT) {
+            err = mpg123_read(decoder, buffer.data(), buffer.size(), &done);
+            total += done;
+        }
+        mpg123_close(decoder);
+    }
+    mpg123_delete(decoder);
+    return total;
+}
+
+struct GapDelegate : AudioPlayerDelegate {
+    AudioPlayer *player = nullptr;
+    std::atomic_int started{0};
+    std::atomic_bool finished{false};
+
+    void updatePlaybackProgress() override {}
+    void updateCacheProgress() override {}
+    void playbackFinished() override { finished = true; }
+    void playbackStarted() override
+    {
+        std::cout << "started " << player->getTrackId() << std::endl;
+        if (++started == 1) {
+            player->queueNext("second", [] { return std::string(); });
+        }
+    }
+};
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3) {
+        std::cerr << "usage: " << argv[0] << " first.mp3 second.mp3"
+                  << std::endl;
+        return 2;
+    }
+
+    mpg123_init();
+    long firstRate     = 0;
+    long secondRate    = 0;
+    int firstChannels  = 0;
+    int secondChannels = 0;
+    uint64_t expected  = decodedBytes(argv[1], firstRate, firstChannels) +
+                        decodedBytes(argv[2], secondRate, secondChannels);
+    mpg123_exit();
+    if (expected == 0) {
+        std::cerr << "cannot decode the input files" << std::endl;
+        return 2;
+    }
+
+    AudioPlayer player;
+    if (!player.setOutputDriver("null")) {
+        std::cerr << "libao has no null driver" << std::endl;
+        return 2;
+    }
+    GapDelegate delegate;
+    delegate.player = &player;
+    player.setDelegate(&delegate);
+
+    auto dir   = fs::temp_directory_path() / fs::unique_path();
+    int status = 1;
+    {
+        AudioCache cache(dir.string());
+        fs::copy_file(argv[1], cache.partialPath("first"));
+        fs::copy_file(argv[2], cache.partialPath("second"));
+        cache.publish("first");
+        cache.publish("second");
+        player.setCache(&cache);
+
+        auto start = Clock::now();
+        player.playTrack("first", std::string());
+        while (!delegate.finished &&
+               Clock::now() - start < std::chrono::minutes(5)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        auto stats = player.getOutputStats();
+
+        double bytesPerMs = firstRate * firstChannels * 2 / 1000.0;
+        int64_t gap       = static_cast<int64_t>(stats.playedBytes) -
+                      static_cast<int64_t>(expected);
+        std::cout << "played " << stats.playedBytes << " bytes, expected "
+                  << expected << ": "
+                  << (gap == 0 ? "sample exact" : "MISMATCH") << " ("
+                  << gap << " bytes, " << gap / bytesPerMs << " ms)"
+                  << std::endl;
+        std::cout << "device opened " << stats.deviceOpens << " times, "
+                  << delegate.started << " tracks started" << std::endl;
+        bool sameFormat =
+            firstRate == secondRate && firstChannels == secondChannels;
+        if (delegate.finished && gap == 0 && delegate.started == 2 &&
+            (!sameFormat || stats.deviceOpens == 1)) {
+            status = 0;
+        }
+        player.setCache(nullptr);
+    }
+    fs::remove_all(dir);
+    return status;
+}
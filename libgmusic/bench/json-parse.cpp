@@ -0,0 +1,167 @@
+// Parses a synthetic trackfeed page into Tracks with JsonReader and with the
+// property_tree path the API used before it.
+//
+// Usage: bench-json-parse [items] [runs]
+
+#include "json/json-reader.hpp"
+#include "model/model.hpp"
+#include "utilities.hpp"
+
+#include <algorithm>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+using namespace gmusic;
+using Clock = std::chrono::steady_clock;
+namespace pt = boost::property_tree;
+
+static std::string makeFeed(size_t items)
+{
+    std::string text = R"({"kind": "sj#trackList", "nextPageToken": "KjQ",)"
+                       R"( "data": {"items": [)";
+    for (size_t i = 0; i < items; ++i) {
+        auto n = std::to_string(i);
+        text += (i > 0 ? ",\n" : "\n");
+        text += R"({"kind": "sj#track", "id": "5a1c0d3e-)" + n +
+                R"(", "clientId": "c)" + n + R"(", "creationTimestamp": ")" +
+                "1500000000" + n + R"(", "lastModifiedTimestamp": ")" +
+                "1600000000" + n + R"(", "recentTimestamp": "1600000000",)" +
+                R"( "deleted": false, "title": "Track \u00e9 )" + n +
+                R"(", "artist": "Artist )" + n + R"(", "composer": "",)" +
+                R"( "album": "Album )" + n + R"(", "albumArtist": "Artist",)" +
+                R"( "year": 2001, "trackNumber": )" +
+                std::to_string(i % 12 + 1) + R"(, "genre": "Rock",)" +
+                R"( "durationMillis": "215000", "albumArtRef": [{"url":)" +
+                R"( "https://lh3.googleusercontent.com/)" + n + R"("}],)" +
+                R"( "artistId": ["A)" + std::to_string(i / 120) +
+                R"("], "albumId": "B)" + std::to_string(i / 12) +
+                R"(", "playCount": 3, "trackType": "8",)" +
+                R"( "estimatedSize": "8612345", "rating": "0"})";
+    }
+    return text + "]}}";
+}
+
+static std::vector<Track> parseWithReader(const std::string &text)
+{
+    std::vector<Track> tracks;
+    json::JsonReader reader(text);
+    auto readItem = [&] {
+        Track track;
+        track.name        = "Untitled track";
+        track.trackType   = "8";
+        track.trackNumber = 1;
+        track.year        = 1970;
+        reader.readObject([&](boost::string_view key) {
+            if (key == "id") {
+                reader.readString(track.trackId);
+            } else if (key == "title") {
+                reader.readString(track.name);
+            } else if (key == "albumId") {
+                reader.readString(track.albumId);
+            } else if (key == "genre") {
+                reader.readString(track.genre);
+            } else if (key == "durationMillis") {
+                track.msDuration = reader.readUnsigned();
+            } else if (key == "trackNumber") {
+                track.trackNumber = static_cast<int>(reader.readInt());
+            } else if (key == "year") {
+                track.year = static_cast<int>(reader.readInt());
+            } else if (key == "trackType") {
+                reader.readString(track.trackType);
+            } else if (key == "estimatedSize") {
+                track.size = reader.readUnsigned();
+            } else if (key == "artistId") {
+                reader.readArray(
+                    [&] { track.artistIds.push_back(reader.readString()); });
+            } else {
+                reader.skipValue();
+            }
+        });
+        tracks.push_back(std::move(track));
+    };
+    reader.readObject([&](boost::string_view key) {
+        if (key != "data") {
+            reader.skipValue();
+            return;
+        }
+        reader.readObject([&](boost::string_view dataKey) {
+            if (dataKey == "items") {
+                reader.readArray(readItem);
+            } else {
+                reader.skipValue();
+            }
+        });
+    });
+    return tracks;
+}
+
+static std::vector<Track> parseWithPtree(const std::string &text)
+{
+    std::vector<Track> tracks;
+    pt::ptree root;
+    std::istringstream istr(text);
+    pt::read_json(istr, root);
+    for (const auto &entry : root.get_child("data.items")) {
+        const auto &item = entry.second;
+        Track track;
+        track.name =
+            item.get_optional<std::string>("title").value_or("Untitled track");
+        track.trackId = item.get<std::string>("id");
+        track.albumId = item.get_optional<std::string>("albumId").value_or("");
+        track.genre   = item.get_optional<std::string>("genre").value_or("");
+        track.msDuration = StringUtils::unsignedLongFromString(
+            item.get_optional<std::string>("durationMillis").value_or("0"));
+        track.trackNumber = item.get_optional<int>("trackNumber").value_or(1);
+        track.year        = item.get_optional<int>("year").value_or(1970);
+        track.trackType =
+            item.get_optional<std::string>("trackType").value_or("8");
+        track.size = StringUtils::unsignedLongFromString(
+            item.get_optional<std::string>("estimatedSize").value_or("0"));
+        for (const auto &artistId : item.get_child("artistId")) {
+            track.artistIds.push_back(artistId.second.get_value<std::string>());
+        }
+        tracks.push_back(std::move(track));
+    }
+    return tracks;
+}
+
+template <class Parser>
+static void run(const char *name,
+                const std::string &text,
+                size_t runs,
+                Parser parse)
+{
+    double bestMs = 0;
+    size_t count  = 0;
+    for (size_t i = 0; i < runs; ++i) {
+        auto start  = Clock::now();
+        auto tracks = parse(text);
+        double ms =
+            std::chrono::duration<double, std::milli>(Clock::now() - start)
+                .count();
+        bestMs = i == 0 ? ms : std::min(bestMs, ms);
+        count  = tracks.size();
+    }
+    std::cout << std::fixed << std::setprecision(1) << name << ": " << count
+              << " tracks in " << bestMs << " ms (best of " << runs << "), "
+              << text.size() / bestMs / 1000 << " MB/s" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t items = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 50000;
+    size_t runs  = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 5;
+    runs         = std::max<size_t>(runs, 1);
+
+    auto text = makeFeed(items);
+    std::cout << "feed of " << items << " items, " << text.size() / 1024
+              << " KiB" << std::endl;
+    run("JsonReader", text, runs, parseWithReader);
+    run("property_tree", text, runs, parseWithPtree);
+    return 0;
+}
@@ -0,0 +1,188 @@
+// CPU time of the volume stage per hour of 44.1 kHz stereo playback: each
+// PcmGain kernel, and apply() with the volume changing now and then, on
+// output-sized buffers.
+//
+// Given an MP3 file, also decodes it the way the player did before, with
+// mpg123_volume() called ahead of every frame, and the way it does now,
+// with PcmGain on the decoded frames, and reports both per hour of audio.
+//
+// Usage: bench-pcm-gain [file.mp3] [runs]
+
+#include "pcm-gain.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <mpg123.h>
+#include <random>
+#include <vector>
+
+using namespace gmusic;
+using Kernel = PcmGain::Kernel;
+
+static const size_t rate          = 44100;
+static const int channels         = 2;
+static const size_t periodSamples = 4096;
+
+static double cpuMs()
+{
+    timespec now;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+    return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
+}
+
+static void report(const char *name, double cpu, double audioSeconds)
+{
+    std::cout << std::fixed << std::setprecision(1) << name << ": " << cpu
+              << " ms cpu, " << cpu * 3600 / audioSeconds
+              << " ms per hour of audio" << std::endl;
+}
+
+// The kernels take the same time whatever the samples are, so the buffer
+// is scaled over and over in place.
+template <class Scale>
+static void runOneHour(const char *name, Scale scale)
+{
+    std::mt19937 random(1);
+    std::vector<int16_t> period(periodSamples);
+    for (auto &sample : period) {
+        sample = static_cast<int16_t>(random());
+    }
+    size_t periods = rate * channels * 3600 / periodSamples;
+
+    double cpu = cpuMs();
+    for (size_t i = 0; i < periods; ++i) {
+        if (!scale(i, period.data(), period.size())) {
+            std::cout << name << ": not available" << std::endl;
+            return;
+        }
+    }
+    report(name, cpuMs() - cpu, 3600);
+}
+
+static void runKernels()
+{
+    std::cout << "volume stage, one hour in buffers of " << periodSamples
+              << " samples:" << std::endl;
+    auto kernel = [](Kernel which) {
+        return [which](size_t, int16_t *samples, size_t count) {
+            return PcmGain::scaleWith(which, samples, count, 23170);
+        };
+    };
+    runOneHour("  scalar", kernel(Kernel::Scalar));
+    runOneHour("  SSE2", kernel(Kernel::Sse2));
+    runOneHour("  AVX2", kernel(Kernel::Avx2));
+
+    PcmGain gain(0.7);
+    runOneHour("  PcmGain::apply, new volume every 100 buffers",
+               [&](size_t i, int16_t *samples, size_t count) {
+                   if (i % 100 == 0) {
+                       gain.setVolume(i % 200 == 0 ? 0.6 : 0.7);
+                   }
+                   gain.apply(samples, count, channels);
+                   return true;
+               });
+}
+
+enum class VolumePath { None, Mpg123Volume, PcmGain };
+
+// Decodes the whole file as playRoutine does and returns the CPU time, or
+// -1 if it cannot be opened. Sets seconds to the length of the audio.
+static double decode(const char *path, VolumePath volumePath, double &seconds)
+{
+    mpg123_handle *decoder = mpg123_new(nullptr, nullptr);
+    const long *rates;
+    size_t rateCount;
+    mpg123_rates(&rates, &rateCount);
+    mpg123_format_none(decoder);
+    for (size_t i = 0; i < rateCount; ++i) {
+        mpg123_format(decoder,
+                      rates[i],
+                      MPG123_MONO | MPG123_STEREO,
+                      MPG123_ENC_SIGNED_16);
+    }
+    if (mpg123_open(decoder, path) != MPG123_OK) {
+        mpg123_delete(decoder);
+        return -1;
+    }
+
+    PcmGain gain(0.7);
+    uint64_t bytes   = 0;
+    long fileRate    = 0;
+    int fileChannels = 0;
+    double cpu       = cpuMs();
+    while (true) {
+        if (volumePath == VolumePath::Mpg123Volume) {
+            mpg123_volume(decoder, 0.7);
+        }
+        off_t frame;
+        unsigned char *audio;
+        size_t done;
+        int err = mpg123_decode_frame(decoder, &frame, &audio, &done);
+        if (err == MPG123_NEW_FORMAT) {
+            int encoding;
+            mpg123_getformat(decoder, &fileRate, &fileChannels, &encoding);
+            continue;
+        }
+        if (err != MPG123_OK) {
+            break;
+        }
+        if (volumePath == VolumePath::PcmGain) {
+            gain.apply(reinterpret_cast<int16_t *>(audio),
+                       done / sizeof(int16_t),
+                       fileChannels);
+        }
+        bytes += done;
+    }
+    cpu = cpuMs() - cpu;
+    mpg123_close(decoder);
+    mpg123_delete(decoder);
+
+    size_t bytesPerSecond = static_cast<size_t>(fileRate) * fileChannels * 2;
+    seconds = bytesPerSecond > 0 ? double(bytes) / bytesPerSecond : 0;
+    return cpu;
+}
+
+static int runDecoder(const char *path, size_t runs)
+{
+    mpg123_init();
+    std::cout << "decoding " << path << ", best of " << runs
+              << " runs:" << std::endl;
+    const struct {
+        const char *name;
+        VolumePath path;
+    } cases[] = {
+        {"  no volume", VolumePath::None},
+        {"  mpg123_volume before every frame", VolumePath::Mpg123Volume},
+        {"  PcmGain on the decoded frames", VolumePath::PcmGain},
+    };
+    int status = 0;
+    for (const auto &test : cases) {
+        double best    = -1;
+        double seconds = 0;
+        for (size_t i = 0; i < runs; ++i) {
+            double cpu = decode(path, test.path, seconds);
+            best       = i == 0 ? cpu : std::min(best, cpu);
+        }
+        if (best < 0 || seconds <= 0) {
+            std::cerr << "cannot decode " << path << std::endl;
+            status = 2;
+            break;
+        }
+        report(test.name, best, seconds);
+    }
+    mpg123_exit();
+    return status;
+}
+
+int main(int argc, char *argv[])
+{
+    runKernels();
+    if (argc > 1) {
+        size_t runs = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 5;
+        return runDecoder(argv[1], std::max<size_t>(runs, 1));
+    }
+    return 0;
+}
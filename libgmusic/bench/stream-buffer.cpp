@@ -0,0 +1,214 @@
+// Hands a download over from a writer thread to a reader thread through
+// StreamBuffer, and through the tmpfile path the player used before it: a
+// mutex around fseek/fwrite and fseek/fread, and a notify per chunk.
+//
+// Reports throughput and process CPU time, also as CPU per second of a
+// 320 kbps stream, for a sequential download, one the reader seeks back
+// in, and one that arrives out of order as after a seek ahead.
+//
+// Usage: bench-stream-buffer [megabytes]
+
+#include "stream-buffer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace gmusic;
+using Clock = std::chrono::steady_clock;
+
+static const size_t maxChunk        = 16 * 1024;
+static const size_t readSize        = 4096;
+static const double streamBytesPerS = 320 * 1000 / 8;
+
+enum class Pattern { Sequential, SeekBack, OutOfOrder };
+
+static double cpuMs()
+{
+    timespec now;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+    return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
+}
+
+static int openTmpFile()
+{
+    FILE *file = std::tmpfile();
+    int fd     = dup(fileno(file));
+    std::fclose(file);
+    return fd;
+}
+
+static void report(const char *name,
+                   size_t bytes,
+                   double wallMs,
+                   double cpu,
+                   size_t mismatches)
+{
+    double megabytes = bytes / 1048576.0;
+    std::cout << std::fixed << std::setprecision(1) << name << ": "
+              << megabytes / wallMs * 1000 << " MB/s, cpu " << cpu << " ms ("
+              << std::setprecision(3) << cpu / (bytes / streamBytesPerS)
+              << " ms per second of audio)";
+    if (mismatches > 0) {
+        std::cout << ", " << mismatches << " reads MISMATCHED";
+    }
+    std::cout << std::endl;
+}
+
+static void runStreamBuffer(const char *name,
+                            const std::vector<char> &source,
+                            Pattern pattern)
+{
+    size_t total = source.size();
+    int fd       = openTmpFile();
+    StreamBuffer buffer;
+    buffer.reset(fd, 0, false);
+
+    auto start = Clock::now();
+    double cpu = cpuMs();
+    std::thread writer([&] {
+        std::mt19937 random(2);
+        auto write = [&](size_t offset, size_t end) {
+            while (offset < end) {
+                size_t len = std::min<size_t>(end - offset,
+                                              1 + random() % maxChunk);
+                if (pwrite(fd, &source[offset], len, offset) < 0) {
+                    std::perror("pwrite");
+                    std::exit(1);
+                }
+                buffer.append(offset, &source[offset], len);
+                offset += len;
+            }
+        };
+        if (pattern == Pattern::OutOfOrder) {
+            write(0, total / 4);
+            write(total / 2, total);
+            write(total / 4, total / 2);
+        } else {
+            write(0, total);
+        }
+        buffer.finish();
+    });
+
+    std::mt19937 random(3);
+    std::vector<char> chunk(readSize);
+    uint64_t position = 0;
+    size_t mismatches = 0;
+    size_t readBytes  = 0;
+    while (true) {
+        if (pattern == Pattern::SeekBack && position > 100000 &&
+            random() % 2000 == 0) {
+            position -= random() % 100000;
+        }
+        size_t len = buffer.read(position, chunk.data(), chunk.size());
+        if (len == 0) {
+            if (buffer.isComplete() && position >= total) {
+                break;
+            }
+            buffer.wait([&] { return buffer.hasData(position); });
+            continue;
+        }
+        if (std::memcmp(chunk.data(), &source[position], len) != 0) {
+            ++mismatches;
+        }
+        position += len;
+        readBytes += len;
+    }
+    writer.join();
+
+    double wallMs =
+        std::chrono::duration<double, std::milli>(Clock::now() - start)
+            .count();
+    report(name, readBytes, wallMs, cpuMs() - cpu, mismatches);
+    auto stats = buffer.getStats();
+    std::cout << "  ring " << stats.ringBytes / 1024 << " KiB, disk "
+              << stats.diskBytes / 1024 << " KiB, spilled "
+              << stats.spilled / 1024 << " KiB, " << stats.waits
+              << " waits, " << stats.wakeups << " wakeups" << std::endl;
+    close(fd);
+}
+
+static void runTmpFile(const std::vector<char> &source)
+{
+    size_t total = source.size();
+    FILE *file   = std::tmpfile();
+    std::mutex mutex;
+    std::condition_variable condvar;
+    bool finished = false;
+
+    auto start = Clock::now();
+    double cpu = cpuMs();
+    std::thread writer([&] {
+        std::mt19937 random(2);
+        size_t offset = 0;
+        while (offset < total) {
+            size_t len =
+                std::min<size_t>(total - offset, 1 + random() % maxChunk);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                std::fseek(file, 0, SEEK_END);
+                std::fwrite(&source[offset], 1, len, file);
+            }
+            condvar.notify_one();
+            offset += len;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        finished = true;
+        condvar.notify_one();
+    });
+
+    std::vector<char> chunk(readSize);
+    long position     = 0;
+    size_t mismatches = 0;
+    while (true) {
+        std::unique_lock<std::mutex> lock(mutex);
+        std::fseek(file, position, SEEK_SET);
+        size_t len = std::fread(chunk.data(), 1, chunk.size(), file);
+        if (len == 0) {
+            if (finished) {
+                break;
+            }
+            condvar.wait_for(lock, std::chrono::milliseconds(1));
+            continue;
+        }
+        lock.unlock();
+        if (std::memcmp(chunk.data(), &source[position], len) != 0) {
+            ++mismatches;
+        }
+        position += static_cast<long>(len);
+    }
+    writer.join();
+
+    double wallMs =
+        std::chrono::duration<double, std::milli>(Clock::now() - start)
+            .count();
+    report("tmpfile", total, wallMs, cpuMs() - cpu, mismatches);
+    std::fclose(file);
+}
+
+int main(int argc, char *argv[])
+{
+    size_t megabytes = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 64;
+    std::vector<char> source(std::max<size_t>(megabytes, 1) << 20);
+    std::mt19937 random(1);
+    for (auto &byte : source) {
+        byte = static_cast<char>(random());
+    }
+
+    runTmpFile(source);
+    runStreamBuffer("StreamBuffer", source, Pattern::Sequential);
+    runStreamBuffer("StreamBuffer, seeking back", source, Pattern::SeekBack);
+    runStreamBuffer("StreamBuffer, out of order", source, Pattern::OutOfOrder);
+    return 0;
+}
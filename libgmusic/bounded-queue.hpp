@@ -0,0 +1,72 @@
+#ifndef BOUNDED_QUEUE_HPP
+#define BOUNDED_QUEUE_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+namespace gmusic
+{
+
+// Blocking FIFO with a fixed capacity for producer/consumer pipelines.
+// close() wakes both sides: push() then fails and pop() drains what is left.
+template <class T> class BoundedQueue
+{
+  public:
+    explicit BoundedQueue(size_t capacity)
+        : capacity(capacity > 0 ? capacity : 1)
+    {
+    }
+
+    bool push(T &&elem);
+    bool pop(T &elem);
+    void close();
+
+  private:
+    std::deque<T> queue;
+    size_t capacity;
+    bool closed = false;
+    std::mutex mutex;
+    std::condition_variable notFull;
+    std::condition_variable notEmpty;
+};
+
+template <class T> bool BoundedQueue<T>::push(T &&elem)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    notFull.wait(lock, [this] { return closed || queue.size() < capacity; });
+    if (closed) {
+        return false;
+    }
+    queue.push_back(std::move(elem));
+    lock.unlock();
+    notEmpty.notify_one();
+    return true;
+}
+
+template <class T> bool BoundedQueue<T>::pop(T &elem)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    notEmpty.wait(lock, [this] { return closed || !queue.empty(); });
+    if (queue.empty()) {
+        return false;
+    }
+    elem = std::move(queue.front());
+    queue.pop_front();
+    lock.unlock();
+    notFull.notify_one();
+    return true;
+}
+
+template <class T> void BoundedQueue<T>::close()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    closed = true;
+    lock.unlock();
+    notFull.notify_all();
+    notEmpty.notify_all();
+}
+
+} // namespace gmusic
+
+#endif // BOUNDED_QUEUE_HPP
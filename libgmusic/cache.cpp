@@ -0,0 +1,275 @@
+#include "cache.hpp"
+#include "utilities.hpp"
+
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <cctype>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+namespace gmusic
+{
+
+namespace fs = boost::filesystem;
+
+static const char *completeExtension = ".mp3";
+static const char *partialExtension  = ".part";
+
+constexpr std::chrono::hours AudioCache::maxPartialAge;
+constexpr std::chrono::minutes AudioCache::partialGracePeriod;
+constexpr std::chrono::seconds AudioCache::indexSaveInterval;
+
+AudioCache::AudioCache(const std::string &directory, uint64_t capacity)
+    : directory{directory}, capacity{capacity}
+{
+    stats.capacity = capacity;
+    load();
+}
+
+AudioCache::~AudioCache()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (indexDirty) {
+        saveIndex();
+    }
+}
+
+// Track ids are plain tokens, but anything unsafe in a file name is
+// replaced all the same.
+std::string AudioCache::pathFor(const std::string &trackId,
+                                const char *extension) const
+{
+    std::string name = trackId;
+    for (auto &c : name) {
+        if (!std::isalnum(static_cast<unsigned char>(c)) && c != '-' &&
+            c != '_') {
+            c = '_';
+        }
+    }
+    return directory + "/" + name + extension;
+}
+
+void AudioCache::load()
+{
+    boost::system::error_code error;
+    fs::create_directories(directory, error);
+    if (error) {
+        ERRLOG << "audio cache: " << error.message() << std::endl;
+        return;
+    }
+
+    auto addEntry = [this](const std::string &trackId, bool oldest) {
+        boost::system::error_code error;
+        auto size = fs::file_size(pathFor(trackId, completeExtension), error);
+        if (error || entries.count(trackId) > 0) {
+            return;
+        }
+        auto position = order.insert(oldest ? order.begin() : order.end(),
+                                     trackId);
+        entries[trackId] = Entry{size, position};
+        stats.bytesUsed += size;
+    };
+
+    std::ifstream index(directory + "/index");
+    std::string line;
+    while (std::getline(index, line)) {
+        if (!line.empty()) {
+            addEntry(line, false);
+        }
+    }
+
+    // Files missing from the index, e.g. after a crash before it was saved,
+    // are kept as the least recently used.
+    for (fs::directory_iterator it(directory, error), end; !error && it != end;
+         it.increment(error)) {
+        if (it->path().extension() == completeExtension) {
+            addEntry(it->path().stem().string(), true);
+        }
+    }
+    evict();
+}
+
+void AudioCache::saveIndex()
+{
+    std::ostringstream out;
+    for (const auto &trackId : order) {
+        out << trackId << '\n';
+    }
+    if (!FSUtils::writeFileAtomically(directory + "/index", out.str())) {
+        ERRLOG << "audio cache: failed to save index" << std::endl;
+    }
+    indexDirty   = false;
+    indexSavedAt = std::chrono::steady_clock::now();
+}
+
+// Partial files are not in the index, since downloads grow them behind the
+// cache's back, so they are looked up on disk each time.
+void AudioCache::evict(const std::string &keepPath)
+{
+    struct PartialFile {
+        std::time_t modified;
+        fs::path path;
+        uint64_t size;
+    };
+    std::vector<PartialFile> partials;
+    auto now = std::time(nullptr);
+    auto age = [now](std::time_t modified) {
+        return std::chrono::seconds(std::max<std::time_t>(now - modified, 0));
+    };
+
+    boost::system::error_code error;
+    stats.partialBytes = 0;
+    for (fs::directory_iterator it(directory, error), end; !error && it != end;
+         it.increment(error)) {
+        if (it->path().extension() != partialExtension ||
+            it->path() == keepPath) {
+            continue;
+        }
+        boost::system::error_code fileError;
+        PartialFile partial{fs::last_write_time(it->path(), fileError),
+                            it->path(),
+                            fs::file_size(it->path(), fileError)};
+        if (fileError || age(partial.modified) < partialGracePeriod) {
+            continue;
+        }
+        if (age(partial.modified) > maxPartialAge) {
+            fs::remove(partial.path, fileError);
+            ++stats.evictions;
+            continue;
+        }
+        stats.partialBytes += partial.size;
+        partials.push_back(partial);
+    }
+
+    std::sort(partials.begin(),
+              partials.end(),
+              [](const PartialFile &a, const PartialFile &b) {
+                  return a.modified < b.modified;
+              });
+    for (const auto &partial : partials) {
+        if (stats.bytesUsed + stats.partialBytes <= capacity) {
+            break;
+        }
+        fs::remove(partial.path, error);
+        stats.partialBytes -= partial.size;
+        ++stats.evictions;
+    }
+
+    while (stats.bytesUsed + stats.partialBytes > capacity &&
+           order.size() > 1) {
+        auto trackId = order.front();
+        boost::system::error_code error;
+        fs::remove(pathFor(trackId, completeExtension), error);
+        stats.bytesUsed -= entries[trackId].size;
+        entries.erase(trackId);
+        order.pop_front();
+        ++stats.evictions;
+        indexDirty = true;
+    }
+}
+
+bool AudioCache::contains(const std::string &trackId) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries.count(trackId) > 0;
+}
+
+// Returns the path of the complete file and marks the track as most
+// recently used, or an empty string if it is not cached.
+std::string AudioCache::lookup(const std::string &trackId)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto entry = entries.find(trackId);
+    if (entry == entries.end()) {
+        ++stats.misses;
+        return std::string();
+    }
+    auto path = pathFor(trackId, completeExtension);
+    if (!fs::exists(path)) {
+        stats.bytesUsed -= entry->second.size;
+        order.erase(entry->second.position);
+        entries.erase(entry);
+        ++stats.misses;
+        indexDirty = true;
+        return std::string();
+    }
+    ++stats.hits;
+    order.splice(order.end(), order, entry->second.position);
+    indexDirty = true;
+    if (std::chrono::steady_clock::now() - indexSavedAt >= indexSaveInterval) {
+        saveIndex();
+    }
+    return path;
+}
+
+// Path to download the track into. A partial file already there holds the
+// first bytes of the track and is counted as a resumed download. Each new
+// download makes room for itself first.
+std::string AudioCache::partialPath(const std::string &trackId)
+{
+    auto path = pathFor(trackId, partialExtension);
+    boost::system::error_code error;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (fs::file_size(path, error) > 0 && !error) {
+        ++stats.resumed;
+    }
+    evict(path);
+    return path;
+}
+
+// Moves a finished download under its final name. Readers that still have
+// the partial file open keep reading the same data.
+bool AudioCache::publish(const std::string &trackId)
+{
+    auto partPath = pathFor(trackId, partialExtension);
+    auto path     = pathFor(trackId, completeExtension);
+
+    boost::system::error_code error;
+    auto size = fs::file_size(partPath, error);
+    if (!error) {
+        fs::rename(partPath, path, error);
+    }
+    if (error) {
+        ERRLOG << "audio cache: failed to publish " << trackId << ": "
+               << error.message() << std::endl;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto entry = entries.find(trackId);
+    if (entry != entries.end()) {
+        stats.bytesUsed -= entry->second.size;
+        order.erase(entry->second.position);
+        entries.erase(entry);
+    }
+    entries[trackId] = Entry{size, order.insert(order.end(), trackId)};
+    stats.bytesUsed += size;
+    evict();
+    saveIndex();
+    return true;
+}
+
+void AudioCache::remove(const std::string &trackId)
+{
+    boost::system::error_code error;
+    fs::remove(pathFor(trackId, partialExtension), error);
+    fs::remove(pathFor(trackId, completeExtension), error);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto entry = entries.find(trackId);
+    if (entry != entries.end()) {
+        stats.bytesUsed -= entry->second.size;
+        order.erase(entry->second.position);
+        entries.erase(entry);
+        saveIndex();
+    }
+}
+
+AudioCacheStats AudioCache::getStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+}
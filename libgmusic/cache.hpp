@@ -0,0 +1,84 @@
+#ifndef CACHE_HPP
+#define CACHE_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace gmusic
+{
+
+struct AudioCacheStats {
+    uint64_t hits      = 0;
+    uint64_t misses    = 0;
+    uint64_t resumed   = 0;
+    uint64_t evictions    = 0;
+    uint64_t bytesUsed    = 0;
+    uint64_t partialBytes = 0;
+    uint64_t capacity     = 0;
+};
+
+// Size bounded directory of downloaded tracks, keyed by track id.
+//
+// A download goes to <id>.part and is renamed to <id>.mp3 by publish() once
+// complete, so a file under the final name is always whole. A .part left
+// by an interrupted download is kept and the next download resumes it.
+// The index file lists complete tracks from least to most recently played.
+// Partial files count toward the capacity too. When the total goes over it,
+// partial files are evicted first, oldest first, then the least recently
+// played tracks; partial files untouched for maxPartialAge are always
+// removed. A partial file written to within partialGracePeriod is left
+// alone, as a download may still be using it.
+//
+// Lookups only reorder the index in memory; it is written at most once
+// per indexSaveInterval by them, and whenever tracks are added or removed.
+class AudioCache
+{
+  public:
+    static const uint64_t defaultCapacity = 2ull * 1024 * 1024 * 1024;
+    static constexpr std::chrono::hours maxPartialAge{24 * 7};
+    static constexpr std::chrono::minutes partialGracePeriod{10};
+    static constexpr std::chrono::seconds indexSaveInterval{60};
+
+    AudioCache(const std::string &directory,
+               uint64_t capacity = defaultCapacity);
+    ~AudioCache();
+
+    AudioCache(const AudioCache &) = delete;
+    AudioCache &operator=(const AudioCache &) = delete;
+
+    bool contains(const std::string &trackId) const;
+    std::string lookup(const std::string &trackId);
+    std::string partialPath(const std::string &trackId);
+    bool publish(const std::string &trackId);
+    void remove(const std::string &trackId);
+
+    AudioCacheStats getStats() const;
+
+  private:
+    struct Entry {
+        uint64_t size;
+        std::list<std::string>::iterator position;
+    };
+
+    std::string pathFor(const std::string &trackId,
+                        const char *extension) const;
+    void load();
+    void saveIndex();
+    void evict(const std::string &keepPath = std::string());
+
+    std::string directory;
+    uint64_t capacity;
+    std::list<std::string> order;
+    std::unordered_map<std::string, Entry> entries;
+    std::chrono::steady_clock::time_point indexSavedAt;
+    bool indexDirty = false;
+    mutable std::mutex mutex;
+    AudioCacheStats stats;
+};
+}
+
+#endif // CACHE_HPP
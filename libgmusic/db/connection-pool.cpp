@@ -0,0 +1,145 @@
+#include "db/connection-pool.hpp"
+
+namespace gmusic
+{
+namespace db
+{
+
+ConnectionPool::Handle::~Handle()
+{
+    if (con != nullptr) {
+        pool->release(con, writable);
+    }
+}
+
+ConnectionPool::Handle::Handle(Handle &&other)
+    : pool(other.pool), con(other.con), writable(other.writable)
+{
+    other.con = nullptr;
+}
+
+ConnectionPool::ConnectionPool(const std::string &dbPath,
+                               size_t readersCount,
+                               const Initializer &initializer)
+    : dbPath{dbPath}, readersCount{readersCount > 0 ? readersCount : 1},
+      initializer{initializer}
+{
+    stats.readersCapacity = this->readersCount;
+}
+
+std::unique_ptr<Connection> ConnectionPool::open(bool writable)
+{
+    auto con = std::make_unique<Connection>(dbPath);
+    if (initializer) {
+        initializer(con.get(), writable);
+    }
+    ++stats.connectionsOpened;
+    return con;
+}
+
+void ConnectionPool::countAcquisition(
+    bool waited, std::chrono::steady_clock::time_point start)
+{
+    using namespace std::chrono;
+
+    ++stats.acquisitions;
+    if (waited) {
+        ++stats.waits;
+        stats.waitTimeUs += static_cast<uint64_t>(
+            duration_cast<microseconds>(steady_clock::now() - start).count());
+    }
+}
+
+ConnectionPool::Handle ConnectionPool::acquireReader()
+{
+    auto start = std::chrono::steady_clock::now();
+    bool waited = false;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    if (idleReaders.empty() && readers.size() < readersCount) {
+        readers.push_back(open(false));
+        idleReaders.push_back(readers.back().get());
+        stats.readersOpened = readers.size();
+    }
+    while (idleReaders.empty()) {
+        waited = true;
+        released.wait(lock);
+    }
+    auto con = idleReaders.back();
+    idleReaders.pop_back();
+    countAcquisition(waited, start);
+
+    return Handle(this, con, false);
+}
+
+ConnectionPool::Handle ConnectionPool::acquireWriter()
+{
+    auto start = std::chrono::steady_clock::now();
+    bool waited = false;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (writerBusy) {
+        waited = true;
+        released.wait(lock);
+    }
+    if (!writer) {
+        writer = open(true);
+    }
+    writerBusy = true;
+    countAcquisition(waited, start);
+
+    return Handle(this, writer.get(), true);
+}
+
+void ConnectionPool::release(Connection *con, bool writable)
+{
+    if (con->inTransaction()) {
+        try {
+            Statement::executeQuery(con, "ROLLBACK");
+        } catch (const DatabaseException &) {
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    if (writable) {
+        writerBusy = false;
+    } else {
+        idleReaders.push_back(con);
+    }
+    lock.unlock();
+    released.notify_all();
+}
+
+void ConnectionPool::close()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    released.wait(lock, [this] {
+        return !writerBusy && idleReaders.size() == readers.size();
+    });
+    idleReaders.clear();
+    readers.clear();
+    writer.reset();
+    stats.readersOpened = 0;
+}
+
+ConnectionPoolStats ConnectionPool::getStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto result = stats;
+
+    auto addCacheStats = [&result](const Connection *con) {
+        auto cacheStats = con->getStatementCacheStats();
+        result.statementCache.hits += cacheStats.hits;
+        result.statementCache.misses += cacheStats.misses;
+        result.statementCache.evictions += cacheStats.evictions;
+    };
+    for (const auto &reader : readers) {
+        addCacheStats(reader.get());
+    }
+    if (writer) {
+        addCacheStats(writer.get());
+    }
+    return result;
+}
+}
+}
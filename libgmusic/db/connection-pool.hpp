@@ -0,0 +1,91 @@
+#ifndef CONNECTION_POOL_HPP
+#define CONNECTION_POOL_HPP
+
+#include "db/db-engine.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace gmusic
+{
+namespace db
+{
+
+struct ConnectionPoolStats {
+    size_t readersCapacity   = 0;
+    size_t readersOpened     = 0;
+    size_t connectionsOpened = 0;
+    uint64_t acquisitions    = 0;
+    uint64_t waits           = 0;
+    uint64_t waitTimeUs      = 0;
+    StatementCacheStats statementCache;
+};
+
+class ConnectionPool
+{
+  public:
+    using Initializer = std::function<void(Connection *, bool writable)>;
+
+    class Handle
+    {
+      public:
+        Handle(ConnectionPool *pool, Connection *con, bool writable)
+            : pool(pool), con(con), writable(writable)
+        {
+        }
+        ~Handle();
+
+        Handle(const Handle &other) = delete;
+        Handle &operator=(const Handle &other) = delete;
+
+        Handle(Handle &&other);
+        Handle &operator=(Handle &&other) = delete;
+
+        Connection *get() const { return con; }
+        Connection *operator->() const { return con; }
+
+      private:
+        ConnectionPool *pool;
+        Connection *con;
+        bool writable;
+    };
+
+    ConnectionPool(const std::string &dbPath,
+                   size_t readersCount,
+                   const Initializer &initializer);
+
+    ConnectionPool(const ConnectionPool &other) = delete;
+    ConnectionPool &operator=(const ConnectionPool &other) = delete;
+
+    Handle acquireReader();
+    Handle acquireWriter();
+    void close();
+    ConnectionPoolStats getStats() const;
+
+  private:
+    void release(Connection *con, bool writable);
+    std::unique_ptr<Connection> open(bool writable);
+    void countAcquisition(bool waited,
+                          std::chrono::steady_clock::time_point start);
+
+    std::string dbPath;
+    size_t readersCount;
+    Initializer initializer;
+
+    std::vector<std::unique_ptr<Connection>> readers;
+    std::vector<Connection *> idleReaders;
+    std::unique_ptr<Connection> writer;
+    bool writerBusy = false;
+
+    mutable std::mutex mutex;
+    std::condition_variable released;
+    ConnectionPoolStats stats;
+};
+}
+}
+
+#endif // CONNECTION_POOL_HPP
@@ -1,62 +1,194 @@
 #include "db/database.hpp"
+#include "db/queries.hpp"
 #include "utilities.hpp"
 
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/algorithm/string/replace.hpp>
+#include <sstream>
+
 namespace gmusic
 {
 namespace db
 {
 
-Database::Database(const std::string &dbPath)
-    : dbPath{dbPath}, artistTable{this}, albumTable{this}, trackTable{this}
+bool StorageProfile::hasSnapshotReads() const
+{
+    return boost::iequals(journalMode, "WAL");
+}
+
+Database::Database(const std::string &dbPath, const StorageProfile &profile)
+    : dbPath{dbPath}, profile{profile},
+      pool{dbPath,
+           profile.readersCount,
+           [this](Connection *con, bool writable) {
+               prepareConnection(con, writable);
+           }},
+      artistTable{this}, albumTable{this}, trackTable{this}
 {
     initialize();
 }
 
 void Database::clear()
 {
-    FSUtils::deleteFile(dbPath);
+    {
+        WriteLock lock(&lifetimeLockHandle);
+        pool.close();
+        FSUtils::deleteFile(dbPath);
+        FSUtils::deleteFile(dbPath + "-wal");
+        FSUtils::deleteFile(dbPath + "-shm");
+    }
     initialize();
 }
 
+static void createInitialSchema(Connection *con)
+{
+    Statement::executeQuery(con,
+                            "CREATE TABLE IF NOT EXISTS Artist(id TEXT "
+                            "PRIMARY KEY, name TEXT, artUrl TEXT, bio "
+                            "TEXT)");
+    Statement::executeQuery(con,
+                            "CREATE TABLE IF NOT EXISTS Album(id TEXT "
+                            "PRIMARY KEY, name TEXT, artUrl TEXT, descr "
+                            "TEXT, year INTEGER)");
+    Statement::executeQuery(con,
+                            "CREATE TABLE IF NOT EXISTS "
+                            "Artist2Album(artistId REFERENCES Artist(id), "
+                            "albumId REFERENCES Album(id))");
+    Statement::executeQuery(con,
+                            "CREATE TABLE IF NOT EXISTS Track("
+                            "id TEXT PRIMARY KEY,"
+                            "albumId REFERENCES Album(id),"
+                            "name TEXT,"
+                            "genre TEXT,"
+                            "duration INTEGER,"
+                            "trackNumber INTEGER,"
+                            "year INTEGER,"
+                            "trackType TEXT)");
+    Statement::executeQuery(con,
+                            "CREATE TABLE IF NOT EXISTS "
+                            "Track2Artist(trackId REFERENCES Track(id), "
+                            "artistId REFERENCES Artist(id))");
+}
+
+static void indexLinkTables(Connection *con)
+{
+    Statement::executeQuery(con,
+                            "DELETE FROM Artist2Album WHERE rowid NOT IN "
+                            "(SELECT min(rowid) FROM Artist2Album "
+                            "GROUP BY artistId, albumId)");
+    Statement::executeQuery(con,
+                            "CREATE UNIQUE INDEX Artist2Album_artist_album "
+                            "ON Artist2Album(artistId, albumId)");
+    Statement::executeQuery(con,
+                            "CREATE INDEX Artist2Album_album_artist "
+                            "ON Artist2Album(albumId, artistId)");
+    Statement::executeQuery(con,
+                            "DELETE FROM Track2Artist WHERE rowid NOT IN "
+                            "(SELECT min(rowid) FROM Track2Artist "
+                            "GROUP BY trackId, artistId)");
+    Statement::executeQuery(con,
+                            "CREATE UNIQUE INDEX Track2Artist_track_artist "
+                            "ON Track2Artist(trackId, artistId)");
+    Statement::executeQuery(con,
+                            "CREATE INDEX Track2Artist_artist_track "
+                            "ON Track2Artist(artistId, trackId)");
+    Statement::executeQuery(
+        con, "CREATE INDEX Track_album_type ON Track(albumId, trackType)");
+}
+
+static const char *trackSearchColumns =
+    "select t.rowid, t.id, t.name, al.name, "
+    "(select group_concat(ar.name, ' ') from Track2Artist ta "
+    "join Artist ar on ar.id = ta.artistId where ta.trackId = t.id), "
+    "t.genre from Track t left join Album al on al.id = t.albumId";
+
+static void createTrackSearch(Connection *con)
+{
+    Statement::executeQuery(con,
+                            "CREATE VIRTUAL TABLE TrackSearch USING fts5("
+                            "trackId UNINDEXED, title, album, artist, genre, "
+                            "tokenize = 'unicode61 remove_diacritics 2', "
+                            "prefix = '2 3')");
+    Statement::executeQuery(con,
+                            std::string("INSERT INTO TrackSearch(rowid, "
+                                        "trackId, title, album, artist, "
+                                        "genre) ") +
+                                trackSearchColumns);
+}
+
+using Migration = void (*)(Connection *);
+
+static const Migration migrations[] = {
+    createInitialSchema, indexLinkTables, createTrackSearch};
+
+static int getSchemaVersion(Connection *con)
+{
+    Statement st(con, "PRAGMA user_version");
+    return st.executeStep() ? st.get<int>(0) : 0;
+}
+
 void Database::initialize()
 {
     perform<void, WriteLock>([](Connection *con) {
-        Statement::executeQuery(con, "BEGIN");
-        Statement::executeQuery(con,
-                                "CREATE TABLE IF NOT EXISTS Artist(id TEXT "
-                                "PRIMARY KEY, name TEXT, artUrl TEXT, bio "
-                                "TEXT)");
-        Statement::executeQuery(con,
-                                "CREATE TABLE IF NOT EXISTS Album(id TEXT "
-                                "PRIMARY KEY, name TEXT, artUrl TEXT, descr "
-                                "TEXT, year INTEGER)");
-        Statement::executeQuery(con,
-                                "CREATE TABLE IF NOT EXISTS "
-                                "Artist2Album(artistId REFERENCES Artist(id), "
-                                "albumId REFERENCES Album(id))");
-        Statement::executeQuery(
-            con,
-            "CREATE TABLE IF NOT EXISTS Track(id TEXT PRIMARY KEY,"
-            "albumId REFERENCES Album(id),"
-            "name TEXT,"
-            "genre TEXT,"
-            "duration INTEGER,"
-            "trackNumber INTEGER,"
-            "year INTEGER,"
-            "trackType TEXT)");
-        Statement::executeQuery(con,
-                                "CREATE TABLE IF NOT EXISTS "
-                                "Track2Artist(trackId REFERENCES Track(id), "
-                                "artistId REFERENCES Artist(id))");
-        Statement::executeQuery(con, "COMMIT");
+        const int latestVersion = sizeof(migrations) / sizeof(migrations[0]);
+        for (int version = getSchemaVersion(con); version < latestVersion;
+             ++version) {
+            Statement::executeQuery(con, "BEGIN");
+            try {
+                migrations[version](con);
+                Statement::executeQuery(con,
+                                        "PRAGMA user_version = " +
+                                            std::to_string(version + 1));
+                Statement::executeQuery(con, "COMMIT");
+            } catch (...) {
+                Statement::executeQuery(con, "ROLLBACK");
+                throw;
+            }
+        }
     });
 }
 
-void Database::prepareConnection(Connection *con) const
+void Database::prepareConnection(Connection *con, bool writable) const
 {
+    using std::to_string;
+
+    Statement::executeQuery(
+        con, "PRAGMA busy_timeout = " + to_string(profile.busyTimeoutMs));
+    if (writable) {
+        Statement::executeQuery(con,
+                                "PRAGMA journal_mode = " + profile.journalMode);
+        Statement::executeQuery(con,
+                                "PRAGMA synchronous = " + profile.synchronous);
+    } else {
+        Statement::executeQuery(con, "PRAGMA query_only = ON");
+    }
+    Statement::executeQuery(
+        con, "PRAGMA mmap_size = " + to_string(profile.mmapSize));
+    Statement::executeQuery(
+        con, "PRAGMA cache_size = " + to_string(profile.cacheSize));
+    Statement::executeQuery(con, "PRAGMA temp_store = " + profile.tempStore);
     Statement::executeQuery(con, "PRAGMA foreign_keys = ON");
 }
 
+// TrackSearch rows share their rowid with Track; the condition selects the
+// tracks whose title, album or artist text may have changed.
+static void reindexTracks(Connection *con,
+                          const std::string &condition,
+                          const std::string &id)
+{
+    Statement::executeQuery(con,
+                            "delete from TrackSearch where rowid in "
+                            "(select t.rowid from Track t where " +
+                                condition + ")",
+                            id);
+    Statement::executeQuery(con,
+                            std::string("insert into TrackSearch(rowid, "
+                                        "trackId, title, album, artist, "
+                                        "genre) ") +
+                                trackSearchColumns + " where " + condition,
+                            id);
+}
+
 static void insertArtist(db::Connection *con, const Artist &item)
 {
     auto insertArtistQuery =
@@ -67,6 +199,10 @@ static void insertArtist(db::Connection *con, const Artist &item)
                             item.name,
                             item.artUrl,
                             item.bio);
+    reindexTracks(con,
+                  "t.id in (select trackId from Track2Artist "
+                  "where artistId = ?)",
+                  item.artistId);
 }
 
 void ArtistTable::insert(const Artist &artist)
@@ -109,11 +245,7 @@ Artist ArtistTable::get(const std::string &id) const
 
             Statement::executeQuery(con, "BEGIN");
 
-            Statement st{con,
-                         "select a.id, a.name, a.artUrl, a.bio, aa.albumId "
-                         "from Artist a "
-                         "join Artist2Album aa on a.id = aa.artistId "
-                         "where a.id = ?"};
+            Statement st{con, queries::selectArtistWithAlbums};
             st.bind(id);
             if (st.executeStep()) {
                 artist.artistId = st.get<std::string>(0);
@@ -132,6 +264,16 @@ Artist ArtistTable::get(const std::string &id) const
         });
 }
 
+bool ArtistTable::contains(const std::string &id) const
+{
+    return getDatabase()->perform<bool, ReadLock>(
+        [&id](Connection *con) -> bool {
+            Statement st(con, "select 1 from Artist where id = ?");
+            st.bind(id);
+            return st.executeStep();
+        });
+}
+
 std::vector<Artist> ArtistTable::getAll() const
 {
     using ArtistList = std::vector<Artist>;
@@ -142,23 +284,22 @@ std::vector<Artist> ArtistTable::getAll() const
             Statement::executeQuery(con, "BEGIN");
 
             Statement st{con,
-                         "select id, name, artUrl, bio "
-                         "from Artist a"};
-            Statement albumsSt{
-                con, "select albumId from Artist2Album where artistId = ?"};
+                         "select a.id, a.name, a.artUrl, a.bio, aa.albumId "
+                         "from Artist a "
+                         "left join Artist2Album aa on a.id = aa.artistId "
+                         "order by a.id"};
             while (st.executeStep()) {
-                Artist artist{st.get<std::string>(0),
-                              st.get<std::string>(1),
-                              st.get<std::string>(2),
-                              st.get<std::string>(3),
-                              std::vector<std::string>()};
-                albumsSt.bind(artist.artistId);
-                while (albumsSt.executeStep()) {
-                    artist.albums.push_back(albumsSt.get<std::string>(0));
+                auto artistId = st.get<std::string>(0);
+                if (result.empty() || result.back().artistId != artistId) {
+                    result.push_back(Artist{std::move(artistId),
+                                            st.get<std::string>(1),
+                                            st.get<std::string>(2),
+                                            st.get<std::string>(3),
+                                            std::vector<std::string>()});
+                }
+                if (!st.isNull(4)) {
+                    result.back().albums.push_back(st.get<std::string>(4));
                 }
-                albumsSt.reset();
-
-                result.push_back(artist);
             }
 
             Statement::executeQuery(con, "COMMIT");
@@ -167,6 +308,38 @@ std::vector<Artist> ArtistTable::getAll() const
         });
 }
 
+std::vector<ArtistAlbumRow> ArtistTable::getAllWithAlbums() const
+{
+    using RowList = std::vector<ArtistAlbumRow>;
+    return getDatabase()->perform<RowList, ReadLock>(
+        [](Connection *con) -> RowList {
+            std::vector<ArtistAlbumRow> rows;
+
+            Statement::executeQuery(con, "BEGIN");
+
+            Statement st{con,
+                         "select distinct ar.id, ar.name, al.id, al.name "
+                         "from Artist ar "
+                         "left join Artist2Album aa on ar.id = aa.artistId "
+                         "left join Album al on al.id = aa.albumId "
+                         "order by ar.name, ar.id, al.name, al.id"};
+            while (st.executeStep()) {
+                ArtistAlbumRow row;
+                row.artistId   = st.get<std::string>(0);
+                row.artistName = st.get<std::string>(1);
+                if (!st.isNull(2)) {
+                    row.albumId   = st.get<std::string>(2);
+                    row.albumName = st.get<std::string>(3);
+                }
+                rows.push_back(std::move(row));
+            }
+
+            Statement::executeQuery(con, "COMMIT");
+
+            return rows;
+        });
+}
+
 static void insertAlbum(db::Connection *con, const Album &album)
 {
     Statement::executeQuery(con,
@@ -179,12 +352,14 @@ static void insertAlbum(db::Connection *con, const Album &album)
                             album.year);
 
     Statement st(con,
-                 "insert into Artist2Album (albumId, artistId) values(?, ?)");
+                 "insert or ignore into Artist2Album (albumId, artistId) "
+                 "values(?, ?)");
     for (const auto &artistId : album.artistIds) {
         st.bind(album.albumId, artistId);
         st.execute();
         st.reset();
     }
+    reindexTracks(con, "t.albumId = ?", album.albumId);
 }
 
 void AlbumTable::insert(const Album &album)
@@ -213,6 +388,14 @@ void AlbumTable::remove(const Album &album)
         Statement::executeQuery(con, "BEGIN");
         Statement::executeQuery(
             con, "delete from Artist2Album where albumId = ?", album.albumId);
+        Statement::executeQuery(con,
+                                "delete from TrackSearch where rowid in "
+                                "(select rowid from Track where albumId = ?)",
+                                album.albumId);
+        Statement::executeQuery(con,
+                                "delete from Track2Artist where trackId in "
+                                "(select id from Track where albumId = ?)",
+                                album.albumId);
         Statement::executeQuery(
             con, "delete from Track where albumId = ?", album.albumId);
         Statement::executeQuery(
@@ -227,9 +410,7 @@ Album AlbumTable::get(const std::string &id) const
         [&id](Connection *con) -> Album {
             Statement::executeQuery(con, "BEGIN");
             Album album;
-            Statement st(
-                con,
-                "select id, name, artUrl, descr, year from Album where id = ?");
+            Statement st(con, queries::selectAlbum);
             st.bind(id);
             while (st.executeStep()) {
                 album.albumId = st.get<std::string>(0);
@@ -238,9 +419,7 @@ Album AlbumTable::get(const std::string &id) const
                 album.descr   = st.get<std::string>(3);
                 album.year    = st.get<int>(4);
             }
-            Statement selectArtistsSt(
-                con,
-                "select distinct artistId from Artist2Album where albumId = ?");
+            Statement selectArtistsSt(con, queries::selectAlbumArtists);
             selectArtistsSt.bind(id);
             while (selectArtistsSt.executeStep()) {
                 album.artistIds.push_back(selectArtistsSt.get<std::string>(0));
@@ -250,6 +429,16 @@ Album AlbumTable::get(const std::string &id) const
         });
 }
 
+bool AlbumTable::contains(const std::string &id) const
+{
+    return getDatabase()->perform<bool, ReadLock>(
+        [&id](Connection *con) -> bool {
+            Statement st(con, "select 1 from Album where id = ?");
+            st.bind(id);
+            return st.executeStep();
+        });
+}
+
 std::vector<Album> AlbumTable::getAll() const
 {
     using AlbumList = std::vector<Album>;
@@ -312,9 +501,17 @@ AlbumTable::getAllForArtist(const std::string &artistId) const
 static void insertTrack(db::Connection *con, const Track &track)
 {
     Statement::executeQuery(con,
-                            "insert or replace into Track(id, albumId, name, "
-                            "genre, duration, trackNumber, year, trackType) "
-                            "values(?, ?, ?, ?, ?, ?, ?, ?)",
+                            "insert into Track(id, albumId, name, genre, "
+                            "duration, trackNumber, year, trackType) "
+                            "values(?, ?, ?, ?, ?, ?, ?, ?) "
+                            "on conflict(id) do update set "
+                            "albumId = excluded.albumId, "
+                            "name = excluded.name, "
+                            "genre = excluded.genre, "
+                            "duration = excluded.duration, "
+                            "trackNumber = excluded.trackNumber, "
+                            "year = excluded.year, "
+                            "trackType = excluded.trackType",
                             track.trackId,
                             track.albumId,
                             track.name,
@@ -331,6 +528,7 @@ static void insertTrack(db::Connection *con, const Track &track)
         st.execute();
         st.reset();
     }
+    reindexTracks(con, "t.id = ?", track.trackId);
 }
 
 void TrackTable::insert(const Track &track)
@@ -353,12 +551,47 @@ void TrackTable::insert(const std::vector<Track> &tracks)
     });
 }
 
+size_t Database::insertBatch(const std::vector<Artist> &artists,
+                             const std::vector<Album> &albums,
+                             const std::vector<Track> &tracks)
+{
+    return perform<size_t, WriteLock>(
+        [&artists, &albums, &tracks](Connection *con) -> size_t {
+            size_t rows = artists.size() + albums.size() + tracks.size();
+
+            Statement::executeQuery(con, "BEGIN");
+            try {
+                for (const auto &artist : artists) {
+                    insertArtist(con, artist);
+                }
+                for (const auto &album : albums) {
+                    insertAlbum(con, album);
+                    rows += album.artistIds.size();
+                }
+                for (const auto &track : tracks) {
+                    insertTrack(con, track);
+                    rows += track.artistIds.size();
+                }
+                Statement::executeQuery(con, "COMMIT");
+            } catch (...) {
+                Statement::executeQuery(con, "ROLLBACK");
+                throw;
+            }
+
+            return rows;
+        });
+}
+
 void TrackTable::remove(const Track &track)
 {
     getDatabase()->perform<void, WriteLock>([&track](Connection *con) {
         Statement::executeQuery(con, "BEGIN");
         Statement::executeQuery(
             con, "delete from Track2Artist where trackId = ?", track.trackId);
+        Statement::executeQuery(con,
+                                "delete from TrackSearch where rowid = "
+                                "(select rowid from Track where id = ?)",
+                                track.trackId);
         Statement::executeQuery(
             con, "delete from Track where id = ?", track.trackId);
         Statement::executeQuery(con, "COMMIT");
@@ -374,10 +607,7 @@ Track TrackTable::get(const std::string &id) const
             Track track;
             Statement::executeQuery(con, "BEGIN");
 
-            Statement st(
-                con,
-                "select id, albumId, name, genre, duration, trackNumber, "
-                "year, trackType from Track where id = ?");
+            Statement st(con, queries::selectTrack);
             st.bind(id);
             while (st.executeStep()) {
                 track.trackId     = st.get<string>(0);
@@ -390,8 +620,7 @@ Track TrackTable::get(const std::string &id) const
                 track.trackType   = st.get<string>(7);
             }
 
-            Statement artistSt(
-                con, "select artistId from Track2Artist where trackId = ?");
+            Statement artistSt(con, queries::selectTrackArtists);
             artistSt.bind(id);
             while (artistSt.executeStep()) {
                 track.artistIds.push_back(artistSt.get<string>(0));
@@ -402,150 +631,185 @@ Track TrackTable::get(const std::string &id) const
         });
 }
 
-std::vector<Track> TrackTable::getAll(TrackType trackType) const
+void TrackTable::forEachListingRow(TrackType trackType,
+                                   const ListingVisitor &visitor) const
 {
     using std::string;
-    using TrackList = std::vector<Track>;
 
-    return getDatabase()->perform<TrackList, ReadLock>(
-        [trackType](Connection *con) -> TrackList {
-            std::vector<Track> tracks;
-            Statement::executeQuery(con, "BEGIN");
+    getDatabase()->perform<void, ReadLock>([trackType,
+                                            &visitor](Connection *con) {
+        Statement::executeQuery(con, "BEGIN");
 
-            std::string statementStr =
-                "select id, albumId, name, genre, duration, "
-                "trackNumber, year, trackType from Track";
-            std::string trackTypeStr = toString(trackType);
-            if (!trackTypeStr.empty()) {
-                statementStr += " where trackType = " + trackTypeStr;
-            }
-            Statement st(con, statementStr);
-            while (st.executeStep()) {
-                Track track;
-                track.trackId     = st.get<string>(0);
-                track.albumId     = st.get<string>(1);
-                track.name        = st.get<string>(2);
-                track.genre       = st.get<string>(3);
-                track.msDuration  = static_cast<uint64_t>(st.get<int>(4));
-                track.trackNumber = st.get<int>(5);
-                track.year        = st.get<int>(6);
-                track.trackType   = st.get<string>(7);
-                tracks.push_back(std::move(track));
-            }
-            Statement::executeQuery(con, "COMMIT");
+        std::string statementStr =
+            "select t.id, t.name, t.genre, t.duration, t.trackNumber, "
+            "al.name, (select ar.name from Artist2Album aa "
+            "join Artist ar on ar.id = aa.artistId "
+            "where aa.albumId = t.albumId limit 1) "
+            "from Track t left join Album al on al.id = t.albumId";
+        std::string trackTypeStr = toString(trackType);
+        if (!trackTypeStr.empty()) {
+            statementStr += " where t.trackType = " + trackTypeStr;
+        }
+        Statement st(con, statementStr);
+        TrackListingRow row;
+        while (st.executeStep()) {
+            row.trackId     = st.get<string>(0);
+            row.name        = st.get<string>(1);
+            row.genre       = st.get<string>(2);
+            row.msDuration  = static_cast<uint64_t>(st.get<int>(3));
+            row.trackNumber = st.get<int>(4);
+            row.albumName   = st.isNull(5) ? string() : st.get<string>(5);
+            row.artistName  = st.isNull(6) ? string() : st.get<string>(6);
+            visitor(row);
+        }
+        Statement::executeQuery(con, "COMMIT");
+    });
+}
 
-            return tracks;
-        });
+void TrackRowView::copyTo(Track &track) const
+{
+    track.trackId.assign(trackId.data(), trackId.size());
+    track.albumId.assign(albumId.data(), albumId.size());
+    track.name.assign(name.data(), name.size());
+    track.genre.assign(genre.data(), genre.size());
+    track.trackType.assign(trackType.data(), trackType.size());
+    track.msDuration  = msDuration;
+    track.trackNumber = trackNumber;
+    track.year        = year;
 }
 
-std::vector<Track> TrackTable::getAllForAlbum(TrackType trackType,
-                                              const std::string &albumId) const
+// Every whitespace separated word of the text becomes a quoted prefix
+// query, so "beat ab" matches tracks with words starting with both.
+static std::string toMatchExpression(const std::string &text)
 {
-    using std::string;
-    using TrackList = std::vector<Track>;
+    std::string expression;
+    std::istringstream words(text);
+    std::string word;
+    while (words >> word) {
+        boost::replace_all(word, "\"", "\"\"");
+        if (!expression.empty()) {
+            expression += ' ';
+        }
+        expression += '"' + word + "\"*";
+    }
+    return expression;
+}
 
-    return getDatabase()->perform<TrackList, ReadLock>(
-        [trackType, albumId](Connection *con) -> TrackList {
-            std::vector<Track> tracks;
-            Statement::executeQuery(con, "BEGIN");
+std::vector<std::string> TrackTable::search(const std::string &text,
+                                            size_t limit) const
+{
+    using IdList = std::vector<std::string>;
 
-            std::string statementStr = "select id, albumId, name, genre, "
-                                       "duration, trackNumber, year, trackType "
-                                       "from Track where albumId = ?";
-            std::string trackTypeStr = toString(trackType);
-            if (!trackTypeStr.empty()) {
-                statementStr += " and trackType = " + trackTypeStr;
-            }
-            Statement st(con, statementStr);
-            st.bind(albumId);
+    auto expression = toMatchExpression(text);
+    if (expression.empty()) {
+        return IdList();
+    }
+
+    return getDatabase()->perform<IdList, ReadLock>(
+        [&expression, limit](Connection *con) -> IdList {
+            IdList trackIds;
+            Statement st(con,
+                         "select trackId from TrackSearch "
+                         "where TrackSearch match ? order by rank limit ?");
+            // A negative limit is none to SQLite.
+            st.bind(expression,
+                    limit == noLimit ? -1 : static_cast<int>(limit));
             while (st.executeStep()) {
-                Track track;
-                track.trackId     = st.get<string>(0);
-                track.albumId     = st.get<string>(1);
-                track.name        = st.get<string>(2);
-                track.genre       = st.get<string>(3);
-                track.msDuration  = static_cast<uint64_t>(st.get<int>(4));
-                track.trackNumber = st.get<int>(5);
-                track.year        = st.get<int>(6);
-                track.trackType   = st.get<string>(7);
-                tracks.push_back(std::move(track));
+                trackIds.push_back(st.get<std::string>(0));
             }
-            Statement::executeQuery(con, "COMMIT");
-
-            return tracks;
+            return trackIds;
         });
 }
 
-std::vector<Track>
-TrackTable::getAllForArtist(TrackType trackType,
-                            const std::string &artistId) const
+void TrackTable::scan(const std::string &query,
+                      const std::string *param,
+                      const RowVisitor &visitor) const
 {
-    using std::string;
-    using TrackList = std::vector<Track>;
+    using boost::string_view;
 
-    return getDatabase()->perform<TrackList, ReadLock>(
-        [trackType, artistId](Connection *con) -> TrackList {
-            std::vector<Track> tracks;
-            Statement::executeQuery(con, "BEGIN");
+    getDatabase()->perform<void, ReadLock>([&](Connection *con) {
+        Statement::executeQuery(con, "BEGIN");
 
-            std::string statementStr = "select id, albumId, name, genre, "
-                                       "duration, trackNumber, year, trackType "
-                                       "from Track a join Track2Artist b on "
-                                       "(a.id = b.trackId and b.artistId = ?)";
-            std::string trackTypeStr = toString(trackType);
-            if (!trackTypeStr.empty()) {
-                statementStr += " where trackType = " + trackTypeStr;
-            }
-            Statement st(con, statementStr);
-            st.bind(artistId);
-            while (st.executeStep()) {
-                Track track;
-                track.trackId     = st.get<string>(0);
-                track.albumId     = st.get<string>(1);
-                track.name        = st.get<string>(2);
-                track.genre       = st.get<string>(3);
-                track.msDuration  = static_cast<uint64_t>(st.get<int>(4));
-                track.trackNumber = st.get<int>(5);
-                track.year        = st.get<int>(6);
-                track.trackType   = st.get<string>(7);
-                tracks.push_back(std::move(track));
+        Statement st(con, query);
+        if (param != nullptr) {
+            st.bind(*param);
+        }
+        TrackRowView row;
+        while (st.executeStep()) {
+            row.trackId     = st.get<string_view>(0);
+            row.albumId     = st.get<string_view>(1);
+            row.name        = st.get<string_view>(2);
+            row.genre       = st.get<string_view>(3);
+            row.msDuration  = static_cast<uint64_t>(st.get<int>(4));
+            row.trackNumber = st.get<int>(5);
+            row.year        = st.get<int>(6);
+            row.trackType   = st.get<string_view>(7);
+            if (!visitor(row)) {
+                break;
             }
-            Statement::executeQuery(con, "COMMIT");
+        }
 
-            return tracks;
-        });
+        Statement::executeQuery(con, "COMMIT");
+    });
+}
+
+static TrackTable::RowVisitor collectInto(std::vector<Track> &tracks)
+{
+    return [&tracks](const TrackRowView &row) {
+        tracks.emplace_back();
+        row.copyTo(tracks.back());
+        return true;
+    };
+}
+
+void TrackTable::forEach(TrackType trackType, const RowVisitor &visitor) const
+{
+    scan(queries::selectTracks(toString(trackType)), nullptr, visitor);
+}
+
+void TrackTable::forEachForAlbum(TrackType trackType,
+                                 const std::string &albumId,
+                                 const RowVisitor &visitor) const
+{
+    scan(queries::selectTracksForAlbum(toString(trackType)), &albumId, visitor);
+}
+
+void TrackTable::forEachForArtist(TrackType trackType,
+                                  const std::string &artistId,
+                                  const RowVisitor &visitor) const
+{
+    scan(queries::selectTracksForArtist(toString(trackType)),
+         &artistId,
+         visitor);
 }
 
 std::vector<Track> TrackTable::getAll() const
 {
-    using std::string;
-    using TrackList = std::vector<Track>;
+    return getAll(TrackType::All);
+}
 
-    return getDatabase()->perform<TrackList, ReadLock>(
-        [](Connection *con) -> TrackList {
-            std::vector<Track> tracks;
-            Statement::executeQuery(con, "BEGIN");
+std::vector<Track> TrackTable::getAll(TrackType trackType) const
+{
+    std::vector<Track> tracks;
+    forEach(trackType, collectInto(tracks));
+    return tracks;
+}
 
-            Statement st(
-                con,
-                "select id, albumId, name, genre, duration, trackNumber, "
-                "year, trackType from Track");
-            while (st.executeStep()) {
-                Track track;
-                track.trackId     = st.get<string>(0);
-                track.albumId     = st.get<string>(1);
-                track.name        = st.get<string>(2);
-                track.genre       = st.get<string>(3);
-                track.msDuration  = static_cast<uint64_t>(st.get<int>(4));
-                track.trackNumber = st.get<int>(5);
-                track.year        = st.get<int>(6);
-                track.trackType   = st.get<string>(7);
-                tracks.push_back(std::move(track));
-            }
-            Statement::executeQuery(con, "COMMIT");
+std::vector<Track> TrackTable::getAllForAlbum(TrackType trackType,
+                                              const std::string &albumId) const
+{
+    std::vector<Track> tracks;
+    forEachForAlbum(trackType, albumId, collectInto(tracks));
+    return tracks;
+}
 
-            return tracks;
-        });
+std::vector<Track>
+TrackTable::getAllForArtist(TrackType trackType,
+                            const std::string &artistId) const
+{
+    std::vector<Track> tracks;
+    forEachForArtist(trackType, artistId, collectInto(tracks));
+    return tracks;
 }
 
 std::string TrackTable::toString(TrackType trackType)
@@ -1,11 +1,14 @@
 #ifndef DATABASE_HPP
 #define DATABASE_HPP
 
+#include "db/connection-pool.hpp"
 #include "db/db-engine.hpp"
 #include "model/model.hpp"
 #include "operation-queue.hpp"
+#include <boost/optional.hpp>
 #include <functional>
 #include <mutex>
+#include <type_traits>
 
 namespace gmusic
 {
@@ -19,19 +22,19 @@ template <class Database> class TableBase
   public:
     TableBase(Database *db) : db(db) {}
 
-    Connection getConnection() const
-    {
-        Connection con(db->getPath());
-        db->prepareConnection(&con);
-        return con;
-    }
-
     Database *getDatabase() const { return db; }
 
   private:
     Database *db;
 };
 
+struct ArtistAlbumRow {
+    std::string artistId;
+    std::string artistName;
+    std::string albumId;
+    std::string albumName;
+};
+
 class ArtistTable : protected TableBase<Database>
 {
   public:
@@ -40,7 +43,9 @@ class ArtistTable : protected TableBase<Database>
     void insert(const std::vector<Artist> &models);
     void remove(const Artist &model);
     std::vector<Artist> getAll() const;
+    std::vector<ArtistAlbumRow> getAllWithAlbums() const;
     Artist get(const std::string &id) const;
+    bool contains(const std::string &id) const;
 };
 
 class AlbumTable : protected TableBase<Database>
@@ -53,13 +58,40 @@ class AlbumTable : protected TableBase<Database>
     std::vector<Album> getAll() const;
     std::vector<Album> getAllForArtist(const std::string &artistId) const;
     Album get(const std::string &id) const;
+    bool contains(const std::string &id) const;
+};
+
+struct TrackListingRow {
+    std::string trackId;
+    std::string name;
+    std::string genre;
+    uint64_t msDuration;
+    int trackNumber;
+    std::string albumName;
+    std::string artistName;
+};
+
+struct TrackRowView {
+    boost::string_view trackId;
+    boost::string_view albumId;
+    boost::string_view name;
+    boost::string_view genre;
+    boost::string_view trackType;
+    uint64_t msDuration;
+    int trackNumber;
+    int year;
+
+    void copyTo(Track &track) const;
 };
 
 class TrackTable : protected TableBase<Database>
 {
   public:
     enum class TrackType { All, Regular, Purchased };
+    using ListingVisitor = std::function<void(const TrackListingRow &)>;
+    using RowVisitor     = std::function<bool(const TrackRowView &)>;
     using TableBase<Database>::TableBase;
+    static const size_t noLimit = 0;
     void insert(const Track &artist);
     void insert(const std::vector<Track> &models);
     void remove(const Track &model);
@@ -70,35 +102,76 @@ class TrackTable : protected TableBase<Database>
                                        const std::string &artistId) const;
     std::vector<Track> getAllForAlbum(TrackType trackType,
                                       const std::string &albumId) const;
+    void forEachListingRow(TrackType trackType,
+                           const ListingVisitor &visitor) const;
+    void forEach(TrackType trackType, const RowVisitor &visitor) const;
+    void forEachForArtist(TrackType trackType,
+                          const std::string &artistId,
+                          const RowVisitor &visitor) const;
+    void forEachForAlbum(TrackType trackType,
+                         const std::string &albumId,
+                         const RowVisitor &visitor) const;
+    std::vector<std::string> search(const std::string &text,
+                                    size_t limit = 1000) const;
 
   private:
     static std::string toString(TrackType trackType);
+    void scan(const std::string &query,
+              const std::string *param,
+              const RowVisitor &visitor) const;
+};
+
+struct StorageProfile {
+    std::string journalMode = "WAL";
+    std::string synchronous = "NORMAL";
+    std::string tempStore   = "MEMORY";
+    int64_t mmapSize        = 64 * 1024 * 1024;
+    int cacheSize           = -8192;
+    int busyTimeoutMs       = 5000;
+    size_t readersCount     = 4;
+
+    bool hasSnapshotReads() const;
 };
 
 class Database
 {
   public:
-    Database(const std::string &dbPath);
-    void prepareConnection(Connection *con) const;
+    Database(const std::string &dbPath,
+             const StorageProfile &profile = StorageProfile());
+    void prepareConnection(Connection *con, bool writable) const;
     void clear();
     std::string getPath() const { return dbPath; }
+    const StorageProfile &getProfile() const { return profile; }
+    ConnectionPoolStats getPoolStats() const { return pool.getStats(); }
     ArtistTable &getArtistTable() { return artistTable; }
     AlbumTable &getAlbumTable() { return albumTable; }
     TrackTable &getTrackTable() { return trackTable; }
 
+    size_t insertBatch(const std::vector<Artist> &artists,
+                       const std::vector<Album> &albums,
+                       const std::vector<Track> &tracks);
+
     template <class Ret, class RWLockType>
     Ret perform(const std::function<Ret(Connection *)> &func)
     {
-        RWLockType lock(&rwLockHandle);
-        Connection con(getPath());
-        prepareConnection(&con);
-        return func(&con);
+        const bool writable = std::is_same<RWLockType, WriteLock>::value;
+
+        ReadLock lifetimeLock(&lifetimeLockHandle);
+        boost::optional<RWLockType> lock;
+        if (writable || !profile.hasSnapshotReads()) {
+            lock.emplace(&rwLockHandle);
+        }
+        auto con = writable ? pool.acquireWriter() : pool.acquireReader();
+        return func(con.get());
     }
 
   private:
     RWLockHandle rwLockHandle;
+    RWLockHandle lifetimeLockHandle;
     void initialize();
     std::string dbPath;
+    StorageProfile profile;
+    ConnectionPool pool;
     ArtistTable artistTable;
     AlbumTable albumTable;
     TrackTable trackTable;
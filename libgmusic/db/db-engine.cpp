@@ -30,20 +30,35 @@ inline static void checkedSqlite3Call(Func func, Args &&... args)
     }
 }
 
-Connection::Connection(const std::string &dbPath)
+Connection::Connection(const std::string &dbPath,
+                       size_t statementCacheCapacity)
+    : statementCacheCapacity(statementCacheCapacity)
 {
     checkedSqlite3Call(sqlite3_open, dbPath.c_str(), &handle);
 }
 
 Connection::~Connection()
 {
-    if (handle != nullptr)
+    if (handle != nullptr) {
+        clearStatementCache();
         sqlite3_close(handle);
+    }
 }
 
 sqlite3 *Connection::getHandle() { return handle; }
 
-Connection::Connection(Connection &&other) : handle(other.handle)
+bool Connection::inTransaction()
+{
+    return sqlite3_get_autocommit(handle) == 0;
+}
+
+Connection::Connection(Connection &&other)
+    : handle(other.handle),
+      statementCacheCapacity(other.statementCacheCapacity),
+      cachedStatements(std::move(other.cachedStatements)),
+      statementIndex(std::move(other.statementIndex)),
+      cacheHits(other.cacheHits.load()), cacheMisses(other.cacheMisses.load()),
+      cacheEvictions(other.cacheEvictions.load())
 {
     other.handle = nullptr;
 }
@@ -51,39 +66,108 @@ Connection::Connection(Connection &&other) : handle(other.handle)
 Connection &Connection::operator=(Connection &&other)
 {
     std::swap(handle, other.handle);
+    std::swap(statementCacheCapacity, other.statementCacheCapacity);
+    std::swap(cachedStatements, other.cachedStatements);
+    std::swap(statementIndex, other.statementIndex);
+    cacheHits      = other.cacheHits.exchange(cacheHits);
+    cacheMisses    = other.cacheMisses.exchange(cacheMisses);
+    cacheEvictions = other.cacheEvictions.exchange(cacheEvictions);
     return *this;
 }
 
-Statement::Statement(Connection *con, const std::string &query)
+sqlite3_stmt *Connection::borrowStatement(const std::string &query)
 {
-    this->con = con;
+    auto indexIter = statementIndex.find(query);
+    if (indexIter != statementIndex.end()) {
+        auto statement = indexIter->second->second;
+        cachedStatements.erase(indexIter->second);
+        statementIndex.erase(indexIter);
+        ++cacheHits;
+        return statement;
+    }
+
+    sqlite3_stmt *statement = nullptr;
     checkedSqlite3Call(sqlite3_prepare_v2,
-                       con->getHandle(),
+                       handle,
                        query.c_str(),
                        -1,
                        &statement,
                        nullptr);
+    ++cacheMisses;
+    return statement;
+}
+
+void Connection::returnStatement(const std::string &query,
+                                 sqlite3_stmt *statement)
+{
+    if (statementCacheCapacity == 0 ||
+        statementIndex.find(query) != statementIndex.end()) {
+        sqlite3_finalize(statement);
+        return;
+    }
+
+    sqlite3_reset(statement);
+    sqlite3_clear_bindings(statement);
+    cachedStatements.emplace_front(query, statement);
+    statementIndex[query] = cachedStatements.begin();
+
+    while (cachedStatements.size() > statementCacheCapacity) {
+        auto &lru = cachedStatements.back();
+        sqlite3_finalize(lru.second);
+        statementIndex.erase(lru.first);
+        cachedStatements.pop_back();
+        ++cacheEvictions;
+    }
+}
+
+void Connection::clearStatementCache()
+{
+    for (auto &cached : cachedStatements) {
+        sqlite3_finalize(cached.second);
+    }
+    cachedStatements.clear();
+    statementIndex.clear();
+}
+
+StatementCacheStats Connection::getStatementCacheStats() const
+{
+    StatementCacheStats stats;
+    stats.hits      = cacheHits;
+    stats.misses    = cacheMisses;
+    stats.evictions = cacheEvictions;
+    return stats;
+}
+
+Statement::Statement(Connection *con, const std::string &query)
+    : con(con), query(query)
+{
+    statement   = con->borrowStatement(query);
     n_of_params = sqlite3_bind_parameter_count(statement);
 }
 
 Statement::~Statement()
 {
     if (statement != nullptr) {
-        sqlite3_finalize(statement);
+        con->returnStatement(query, statement);
     }
 }
 
 Statement::Statement(Statement &&other)
     : statement(other.statement), con(other.con),
-      n_of_params(other.n_of_params), binded_count(other.binded_count)
+      query(std::move(other.query)), n_of_params(other.n_of_params),
+      binded_count(other.binded_count)
 {
     other.statement = nullptr;
 }
 
 Statement &Statement::operator=(Statement &&other)
 {
+    if (statement != nullptr) {
+        con->returnStatement(query, statement);
+    }
     statement       = other.statement;
     con             = other.con;
+    query           = std::move(other.query);
     n_of_params     = other.n_of_params;
     binded_count    = other.binded_count;
     other.statement = nullptr;
@@ -143,6 +227,24 @@ template <> std::string Statement::get<std::string>(int colNum)
     return std::string{text, text + length};
 }
 
+template <> boost::string_view Statement::get<boost::string_view>(int colNum)
+{
+    int colType = sqlite3_column_type(statement, colNum);
+    if (colType != SQLITE_TEXT) {
+        throw DatabaseException{"error: wrong column type"};
+    }
+
+    auto text  = sqlite3_column_text(statement, colNum);
+    int length = sqlite3_column_bytes(statement, colNum);
+    return boost::string_view{reinterpret_cast<const char *>(text),
+                              static_cast<size_t>(length)};
+}
+
+bool Statement::isNull(int colNum)
+{
+    return sqlite3_column_type(statement, colNum) == SQLITE_NULL;
+}
+
 bool Statement::executeStep()
 {
     int errCode = sqlite3_step(statement);
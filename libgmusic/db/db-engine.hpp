@@ -1,7 +1,13 @@
 #ifndef DB_ENGINE_HPP
 #define DB_ENGINE_HPP
 
+#include <atomic>
+#include <boost/utility/string_view.hpp>
+#include <cstdint>
+#include <list>
 #include <memory>
+#include <string>
+#include <unordered_map>
 
 struct sqlite3;
 struct sqlite3_stmt;
@@ -15,10 +21,19 @@ struct DatabaseException : public std::runtime_error {
     using std::runtime_error::runtime_error;
 };
 
+struct StatementCacheStats {
+    uint64_t hits      = 0;
+    uint64_t misses    = 0;
+    uint64_t evictions = 0;
+};
+
 class Connection
 {
   public:
-    Connection(const std::string &dbPath);
+    static const size_t defaultStatementCacheCapacity = 64;
+
+    Connection(const std::string &dbPath,
+               size_t statementCacheCapacity = defaultStatementCacheCapacity);
     ~Connection();
 
     Connection(const Connection &other) = delete;
@@ -28,9 +43,24 @@ class Connection
     Connection &operator=(Connection &&other);
 
     sqlite3 *getHandle();
+    bool inTransaction();
+
+    sqlite3_stmt *borrowStatement(const std::string &query);
+    void returnStatement(const std::string &query, sqlite3_stmt *statement);
+    void clearStatementCache();
+    StatementCacheStats getStatementCacheStats() const;
 
   private:
+    using CachedStatement = std::pair<std::string, sqlite3_stmt *>;
+    using StatementList   = std::list<CachedStatement>;
+
     sqlite3 *handle = nullptr;
+    size_t statementCacheCapacity;
+    StatementList cachedStatements;
+    std::unordered_map<std::string, StatementList::iterator> statementIndex;
+    std::atomic<uint64_t> cacheHits{0};
+    std::atomic<uint64_t> cacheMisses{0};
+    std::atomic<uint64_t> cacheEvictions{0};
 };
 
 class Statement
@@ -55,6 +85,7 @@ class Statement
     void execute();
 
     template <class T> T get(int columnNum);
+    bool isNull(int columnNum);
 
     template <class... Args>
     static void
@@ -79,12 +110,15 @@ class Statement
     void bindOne(const std::string &);
     sqlite3_stmt *statement = nullptr;
     Connection *con;
+    std::string query;
     int n_of_params;
     int binded_count = 1;
 };
 
 template <> std::string Statement::get<std::string>(int columnNum);
 template <> int Statement::get<int>(int columnNum);
+template <>
+boost::string_view Statement::get<boost::string_view>(int columnNum);
 
 template <class T, class... Args> void Statement::bind(T &&arg, Args &&... args)
 {
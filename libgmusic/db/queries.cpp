@@ -0,0 +1,64 @@
+#include "db/queries.hpp"
+
+namespace gmusic
+{
+namespace db
+{
+namespace queries
+{
+
+const char *const selectTrack =
+    "select id, albumId, name, genre, duration, trackNumber, "
+    "year, trackType from Track where id = ?";
+
+const char *const selectTrackArtists =
+    "select artistId from Track2Artist where trackId = ?";
+
+const char *const selectArtistWithAlbums =
+    "select a.id, a.name, a.artUrl, a.bio, aa.albumId "
+    "from Artist a "
+    "join Artist2Album aa on a.id = aa.artistId "
+    "where a.id = ?";
+
+const char *const selectAlbum =
+    "select id, name, artUrl, descr, year from Album where id = ?";
+
+const char *const selectAlbumArtists =
+    "select distinct artistId from Artist2Album where albumId = ?";
+
+static const char *selectTracksQuery =
+    "select t.id, t.albumId, t.name, t.genre, t.duration, t.trackNumber, "
+    "t.year, t.trackType from Track t";
+
+static std::string appendTrackType(std::string query,
+                                   const std::string &trackType,
+                                   bool hasWhere)
+{
+    if (!trackType.empty()) {
+        query += hasWhere ? " and " : " where ";
+        query += "t.trackType = " + trackType;
+    }
+    return query;
+}
+
+std::string selectTracks(const std::string &trackType)
+{
+    return appendTrackType(selectTracksQuery, trackType, false);
+}
+
+std::string selectTracksForAlbum(const std::string &trackType)
+{
+    std::string query = selectTracksQuery;
+    query += " where t.albumId = ?";
+    return appendTrackType(query, trackType, true);
+}
+
+std::string selectTracksForArtist(const std::string &trackType)
+{
+    std::string query = selectTracksQuery;
+    query += " join Track2Artist b on (t.id = b.trackId and b.artistId = ?)";
+    return appendTrackType(query, trackType, false);
+}
+}
+}
+}
@@ -0,0 +1,29 @@
+#ifndef QUERIES_HPP
+#define QUERIES_HPP
+
+#include <string>
+
+namespace gmusic
+{
+namespace db
+{
+// SQL of the per track, artist and album lookups, shared by the tables
+// that run it and the query plan test. A track type is the code from
+// TrackTable, or empty for all types.
+namespace queries
+{
+
+extern const char *const selectTrack;
+extern const char *const selectTrackArtists;
+extern const char *const selectArtistWithAlbums;
+extern const char *const selectAlbum;
+extern const char *const selectAlbumArtists;
+
+std::string selectTracks(const std::string &trackType);
+std::string selectTracksForAlbum(const std::string &trackType);
+std::string selectTracksForArtist(const std::string &trackType);
+}
+}
+}
+
+#endif // QUERIES_HPP
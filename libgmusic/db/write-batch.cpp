@@ -0,0 +1,131 @@
+#include "db/write-batch.hpp"
+#include "utilities.hpp"
+
+#include <chrono>
+
+namespace gmusic
+{
+namespace db
+{
+
+WriteBatch::WriteBatch(Database *db, size_t flushThreshold)
+    : db(db), flushThreshold(flushThreshold > 0 ? flushThreshold : 1),
+      writerThread(&WriteBatch::writerRoutine, this)
+{
+}
+
+WriteBatch::~WriteBatch()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    stopping = true;
+    lock.unlock();
+    hasWork.notify_one();
+    writerThread.join();
+}
+
+void WriteBatch::add(const Artist &artist)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    artists.push_back(artist);
+    enqueued(lock);
+}
+
+void WriteBatch::add(const Album &album)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    albums.push_back(album);
+    enqueued(lock);
+}
+
+void WriteBatch::add(const Track &track)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    tracks.push_back(track);
+    enqueued(lock);
+}
+
+void WriteBatch::enqueued(std::unique_lock<std::mutex> &lock)
+{
+    ++queuedCount;
+    if (queuedCount - writtenCount >= flushThreshold) {
+        lock.unlock();
+        hasWork.notify_one();
+    }
+}
+
+// Returns false if any rows added since the previous flush() were dropped,
+// including by flushes the threshold triggered in between.
+bool WriteBatch::flush()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    auto target    = queuedCount;
+    flushRequested = true;
+    hasWork.notify_one();
+    written.wait(lock, [this, target] { return writtenCount >= target; });
+    bool success     = !failedSinceFlush;
+    failedSinceFlush = false;
+    return success;
+}
+
+WriteBatchStats WriteBatch::getStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+void WriteBatch::writerRoutine()
+{
+    using namespace std::chrono;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        hasWork.wait(lock, [this] {
+            return stopping || flushRequested ||
+                   queuedCount - writtenCount >= flushThreshold;
+        });
+        if (queuedCount == writtenCount) {
+            flushRequested = false;
+            written.notify_all();
+            if (stopping) {
+                return;
+            }
+            continue;
+        }
+
+        std::vector<Artist> flushedArtists;
+        std::vector<Album> flushedAlbums;
+        std::vector<Track> flushedTracks;
+        flushedArtists.swap(artists);
+        flushedAlbums.swap(albums);
+        flushedTracks.swap(tracks);
+        auto flushedCount = queuedCount;
+        lock.unlock();
+
+        size_t rows  = 0;
+        bool success = true;
+        auto start   = steady_clock::now();
+        try {
+            rows = db->insertBatch(flushedArtists, flushedAlbums, flushedTracks);
+        } catch (const std::exception &exc) {
+            ERRLOG << "WriteBatch: flush failed: " << exc.what() << std::endl;
+            success = false;
+        }
+        auto elapsed = duration_cast<microseconds>(steady_clock::now() - start);
+
+        lock.lock();
+        ++stats.flushes;
+        stats.flushTimeUs += static_cast<uint64_t>(elapsed.count());
+        if (success) {
+            stats.rowsWritten += rows;
+        } else {
+            ++stats.failedFlushes;
+            failedSinceFlush = true;
+            stats.rowsDropped += flushedArtists.size() + flushedAlbums.size() +
+                                 flushedTracks.size();
+        }
+        writtenCount = flushedCount;
+        written.notify_all();
+    }
+}
+}
+}
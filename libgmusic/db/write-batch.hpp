@@ -0,0 +1,72 @@
+#ifndef WRITE_BATCH_HPP
+#define WRITE_BATCH_HPP
+
+#include "db/database.hpp"
+#include "model/model.hpp"
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace gmusic
+{
+namespace db
+{
+
+struct WriteBatchStats {
+    uint64_t rowsWritten   = 0;
+    uint64_t rowsDropped   = 0;
+    uint64_t flushes       = 0;
+    uint64_t failedFlushes = 0;
+    uint64_t flushTimeUs   = 0;
+
+    double rowsPerSecond() const
+    {
+        return flushTimeUs == 0 ? 0 : rowsWritten * 1000000.0 / flushTimeUs;
+    }
+};
+
+class WriteBatch
+{
+  public:
+    static const size_t defaultFlushThreshold = 2000;
+
+    WriteBatch(Database *db, size_t flushThreshold = defaultFlushThreshold);
+    ~WriteBatch();
+
+    WriteBatch(const WriteBatch &other) = delete;
+    WriteBatch &operator=(const WriteBatch &other) = delete;
+
+    void add(const Artist &artist);
+    void add(const Album &album);
+    void add(const Track &track);
+    bool flush();
+    WriteBatchStats getStats() const;
+
+  private:
+    void enqueued(std::unique_lock<std::mutex> &lock);
+    void writerRoutine();
+
+    Database *db;
+    size_t flushThreshold;
+
+    std::vector<Artist> artists;
+    std::vector<Album> albums;
+    std::vector<Track> tracks;
+    uint64_t queuedCount  = 0;
+    uint64_t writtenCount = 0;
+    bool flushRequested   = false;
+    bool stopping         = false;
+    bool failedSinceFlush = false;
+    WriteBatchStats stats;
+
+    mutable std::mutex mutex;
+    std::condition_variable hasWork;
+    std::condition_variable written;
+    std::thread writerThread;
+};
+}
+}
+
+#endif // WRITE_BATCH_HPP
@@ -0,0 +1,246 @@
+#include "http/http-client.hpp"
+#include "utilities.hpp"
+
+namespace gmusic
+{
+
+static const int pollTimeoutMs = 1000;
+// A transfer fails when it cannot connect in time or stalls below the
+// low speed limit for the low speed time, instead of holding its slot and
+// its caller forever.
+static const long connectTimeoutSec = 15;
+static const long lowSpeedLimit     = 1;
+static const long lowSpeedTimeSec   = 30;
+
+struct HttpClient::Transfer {
+    Transfer() : handle(curl_easy_init()) {}
+    ~Transfer()
+    {
+        curl_easy_cleanup(handle);
+        curl_slist_free_all(headers);
+    }
+
+    CURL *handle;
+    struct curl_slist *headers = nullptr;
+    std::string url;
+    std::string body;
+    std::string text;
+    HttpResponse::HeaderDict headerDict;
+    CompletionHandler handler;
+};
+
+static void complete(const HttpClient::CompletionHandler &handler,
+                     const HttpResponse &response)
+{
+    try {
+        handler(response);
+    } catch (const std::exception &e) {
+        ERRLOG << "HTTP completion handler failed: " << e.what() << std::endl;
+    }
+}
+
+static HttpResponse stoppedResponse(const std::string &url)
+{
+    return HttpResponse(
+        0,
+        url,
+        HttpResponse::HeaderDict(),
+        std::string(),
+        HttpError(HttpErrorCode::INTERNAL_ERROR, "HTTP client stopped"));
+}
+
+static size_t writeText(char *data, size_t size, size_t nmemb, void *userdata)
+{
+    size_t len = size * nmemb;
+    static_cast<std::string *>(userdata)->append(data, len);
+    return len;
+}
+
+static size_t
+writeHeader(char *buffer, size_t size, size_t nitems, void *userdata)
+{
+    auto headerDict = static_cast<HttpResponse::HeaderDict *>(userdata);
+    size_t len      = size * nitems;
+    parseHeaderLine(buffer, len, *headerDict);
+    return len;
+}
+
+HttpClient::HttpClient(long maxHostConnections) : multi(curl_multi_init())
+{
+    curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+    curl_multi_setopt(
+        multi, CURLMOPT_MAX_HOST_CONNECTIONS, maxHostConnections);
+}
+
+HttpClient::~HttpClient()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopped = true;
+    }
+    curl_multi_wakeup(multi);
+    if (ioThread.joinable()) {
+        ioThread.join();
+    }
+    curl_multi_cleanup(multi);
+}
+
+void HttpClient::start()
+{
+    if (!started) {
+        started  = true;
+        ioThread = std::thread(&HttpClient::run, this);
+    }
+}
+
+void HttpClient::send(const HttpRequest &request, CompletionHandler handler)
+{
+    std::unique_ptr<Transfer> transfer(new Transfer);
+    transfer->handler = std::move(handler);
+    transfer->url     = request.getUrl();
+    if (!request.getParamString().empty()) {
+        transfer->url.append("?");
+        transfer->url.append(request.getParamString());
+    }
+    for (auto &header : request.getHeaders()) {
+        auto line         = header.first + ": " + header.second;
+        transfer->headers = curl_slist_append(transfer->headers, line.c_str());
+    }
+
+    CURL *handle = transfer->handle;
+    curl_easy_setopt(handle, CURLOPT_URL, transfer->url.c_str());
+    curl_easy_setopt(handle, CURLOPT_HTTPHEADER, transfer->headers);
+    curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+    curl_easy_setopt(handle, CURLOPT_PIPEWAIT, 1L);
+    curl_easy_setopt(handle, CURLOPT_CONNECTTIMEOUT, connectTimeoutSec);
+    curl_easy_setopt(handle, CURLOPT_LOW_SPEED_LIMIT, lowSpeedLimit);
+    curl_easy_setopt(handle, CURLOPT_LOW_SPEED_TIME, lowSpeedTimeSec);
+    curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, writeText);
+    curl_easy_setopt(handle, CURLOPT_WRITEDATA, &transfer->text);
+    curl_easy_setopt(handle, CURLOPT_HEADERFUNCTION, writeHeader);
+    curl_easy_setopt(handle, CURLOPT_HEADERDATA, &transfer->headerDict);
+    if (request.getMethod() == HttpMethod::POST) {
+        transfer->body = request.getBody();
+        curl_easy_setopt(handle, CURLOPT_POSTFIELDS, transfer->body.c_str());
+        curl_easy_setopt(handle,
+                         CURLOPT_POSTFIELDSIZE,
+                         static_cast<long>(transfer->body.size()));
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    if (stopped) {
+        lock.unlock();
+        complete(transfer->handler, stoppedResponse(transfer->url));
+        return;
+    }
+    pending.push_back(std::move(transfer));
+    ++stats.requests;
+    start();
+    lock.unlock();
+    curl_multi_wakeup(multi);
+}
+
+std::future<HttpResponse> HttpClient::send(const HttpRequest &request)
+{
+    auto promise = std::make_shared<std::promise<HttpResponse>>();
+    auto future  = promise->get_future();
+    send(request,
+         [promise](const HttpResponse &response) {
+             promise->set_value(response);
+         });
+    return future;
+}
+
+void HttpClient::run()
+{
+    std::vector<std::unique_ptr<Transfer>> added;
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopped) {
+                break;
+            }
+            added.swap(pending);
+            stats.inFlight += added.size();
+            stats.maxInFlight = std::max(stats.maxInFlight, stats.inFlight);
+        }
+        for (auto &transfer : added) {
+            CURL *handle = transfer->handle;
+            curl_multi_add_handle(multi, handle);
+            active.emplace(handle, std::move(transfer));
+        }
+        added.clear();
+
+        int running = 0;
+        curl_multi_perform(multi, &running);
+
+        int queued = 0;
+        while (CURLMsg *message = curl_multi_info_read(multi, &queued)) {
+            if (message->msg == CURLMSG_DONE) {
+                finish(message->easy_handle, message->data.result);
+            }
+        }
+
+        curl_multi_poll(multi, nullptr, 0, pollTimeoutMs, nullptr);
+    }
+
+    // Whatever is still outstanding fails instead of leaving callers
+    // waiting on a future that never completes.
+    for (auto &entry : active) {
+        curl_multi_remove_handle(multi, entry.first);
+        pending.push_back(std::move(entry.second));
+    }
+    active.clear();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.inFlight = 0;
+    }
+    for (auto &transfer : pending) {
+        complete(transfer->handler, stoppedResponse(transfer->url));
+    }
+    pending.clear();
+}
+
+void HttpClient::finish(CURL *handle, CURLcode result)
+{
+    curl_multi_remove_handle(multi, handle);
+    auto entry = active.find(handle);
+    if (entry == active.end()) {
+        return;
+    }
+    auto transfer = std::move(entry->second);
+    active.erase(entry);
+
+    long statusCode = 0;
+    long connects   = 0;
+    char *url       = nullptr;
+    curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &statusCode);
+    curl_easy_getinfo(handle, CURLINFO_NUM_CONNECTS, &connects);
+    curl_easy_getinfo(handle, CURLINFO_EFFECTIVE_URL, &url);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        --stats.inFlight;
+        stats.connectionsOpened += static_cast<uint64_t>(connects);
+        if (result != CURLE_OK) {
+            ++stats.failures;
+        }
+    }
+
+    HttpError error = HttpError::createFromCurlCode(
+        static_cast<int>(result), curl_easy_strerror(result));
+    HttpResponse response(statusCode,
+                          url != nullptr ? url : transfer->url,
+                          std::move(transfer->headerDict),
+                          std::move(transfer->text),
+                          error);
+    complete(transfer->handler, response);
+}
+
+HttpClientStats HttpClient::getStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+}
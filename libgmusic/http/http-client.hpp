@@ -0,0 +1,67 @@
+#ifndef HTTP_CLIENT_HPP
+#define HTTP_CLIENT_HPP
+
+#include <curl/curl.h>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "http/httpsession.hpp"
+
+namespace gmusic
+{
+
+struct HttpClientStats {
+    uint64_t requests          = 0;
+    uint64_t failures          = 0;
+    uint64_t connectionsOpened = 0;
+    size_t inFlight            = 0;
+    size_t maxInFlight         = 0;
+};
+
+// Event driven HTTP client. All transfers run on one I/O thread through a
+// curl multi handle, so any number of requests can be outstanding without
+// a thread per request, and requests to the same host are multiplexed over
+// a single HTTP/2 connection when the server supports it.
+//
+// Completion handlers are called on the I/O thread and must not block.
+class HttpClient
+{
+  public:
+    using CompletionHandler = std::function<void(const HttpResponse &)>;
+    static const long defaultMaxHostConnections = 8;
+
+    explicit HttpClient(long maxHostConnections = defaultMaxHostConnections);
+    ~HttpClient();
+
+    HttpClient(const HttpClient &) = delete;
+    HttpClient &operator=(const HttpClient &) = delete;
+
+    void send(const HttpRequest &request, CompletionHandler handler);
+    std::future<HttpResponse> send(const HttpRequest &request);
+
+    HttpClientStats getStats() const;
+
+  private:
+    struct Transfer;
+
+    void start();
+    void run();
+    void finish(CURL *handle, CURLcode result);
+
+    CURLM *multi;
+    std::thread ioThread;
+    mutable std::mutex mutex;
+    std::vector<std::unique_ptr<Transfer>> pending;
+    std::map<CURL *, std::unique_ptr<Transfer>> active;
+    bool started = false;
+    bool stopped = false;
+    HttpClientStats stats;
+};
+}
+
+#endif // HTTP_CLIENT_HPP
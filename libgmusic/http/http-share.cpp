@@ -0,0 +1,50 @@
+#include "http/http-share.hpp"
+
+namespace gmusic
+{
+
+HttpShare::HttpShare() : handle(curl_share_init())
+{
+    curl_share_setopt(handle, CURLSHOPT_LOCKFUNC, &HttpShare::lock);
+    curl_share_setopt(handle, CURLSHOPT_UNLOCKFUNC, &HttpShare::unlock);
+    curl_share_setopt(handle, CURLSHOPT_USERDATA, this);
+    curl_share_setopt(handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    curl_share_setopt(handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+}
+
+HttpShare::~HttpShare() { curl_share_cleanup(handle); }
+
+void HttpShare::lock(CURL *, curl_lock_data data, curl_lock_access, void *self)
+{
+    static_cast<HttpShare *>(self)->mutexes[data].lock();
+}
+
+void HttpShare::unlock(CURL *, curl_lock_data data, void *self)
+{
+    static_cast<HttpShare *>(self)->mutexes[data].unlock();
+}
+
+// CURLINFO_NUM_CONNECTS is zero when the transfer went over a connection
+// that was already open, i.e. no TCP or TLS handshake was needed.
+void HttpShare::recordTransfer(CURL *easyHandle)
+{
+    long connects = 0;
+    curl_easy_getinfo(easyHandle, CURLINFO_NUM_CONNECTS, &connects);
+    ++requests;
+    if (connects > 0) {
+        connectionsOpened += static_cast<uint64_t>(connects);
+    } else {
+        ++handshakesAvoided;
+    }
+}
+
+HttpShareStats HttpShare::getStats() const
+{
+    HttpShareStats stats;
+    stats.requests          = requests;
+    stats.connectionsOpened = connectionsOpened;
+    stats.handshakesAvoided = handshakesAvoided;
+    return stats;
+}
+}
@@ -0,0 +1,47 @@
+#ifndef HTTP_SHARE_HPP
+#define HTTP_SHARE_HPP
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <curl/curl.h>
+#include <mutex>
+
+namespace gmusic
+{
+
+struct HttpShareStats {
+    uint64_t requests          = 0;
+    uint64_t connectionsOpened = 0;
+    uint64_t handshakesAvoided = 0;
+};
+
+// Wraps a curl share object so that every HttpSession attached to it uses
+// one DNS cache, one TLS session cache and one pool of live connections.
+// Must outlive the sessions attached to it.
+class HttpShare
+{
+  public:
+    HttpShare();
+    ~HttpShare();
+
+    HttpShare(const HttpShare &) = delete;
+    HttpShare &operator=(const HttpShare &) = delete;
+
+    CURLSH *getHandle() const { return handle; }
+    void recordTransfer(CURL *easyHandle);
+    HttpShareStats getStats() const;
+
+  private:
+    static void lock(CURL *, curl_lock_data data, curl_lock_access, void *);
+    static void unlock(CURL *, curl_lock_data data, void *);
+
+    CURLSH *handle;
+    std::array<std::mutex, CURL_LOCK_DATA_LAST> mutexes;
+    std::atomic<uint64_t> requests{0};
+    std::atomic<uint64_t> connectionsOpened{0};
+    std::atomic<uint64_t> handshakesAvoided{0};
+};
+}
+
+#endif // HTTP_SHARE_HPP
@@ -52,8 +52,6 @@ HttpErrorCode HttpError::getErrorCodeForCurlError(unsigned curl_code)
         return HttpErrorCode::SSL_LOCAL_CERTIFICATE_ERROR;
     case CURLE_SSL_CIPHER:
         return HttpErrorCode::GENERIC_SSL_ERROR;
-    case CURLE_SSL_CACERT:
-        return HttpErrorCode::SSL_CACERT_ERROR;
     case CURLE_USE_SSL_FAILED:
         return HttpErrorCode::GENERIC_SSL_ERROR;
     case CURLE_SSL_ENGINE_INITFAILED:
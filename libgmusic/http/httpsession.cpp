@@ -69,25 +69,28 @@ static int progress_callback(HttpSession *client_p,
     return client_p->getProgressCallback()(dltotal, dlnow, client_p);
 }
 
+void parseHeaderLine(const char *data,
+                     size_t length,
+                     HttpResponse::HeaderDict &headers)
+{
+    std::string line(data, length);
+    if (boost::starts_with(line, "HTTP/")) {
+        headers.clear();
+        return;
+    }
+    auto separator = line.find(':');
+    if (separator != std::string::npos) {
+        auto key     = boost::trim_copy(line.substr(0, separator));
+        headers[key] = boost::trim_copy(line.substr(separator + 1));
+    }
+}
+
 static size_t
 header_callback(char *buffer, size_t size, size_t nitems, void *userdata)
 {
-    using Dict       = std::map<std::string, std::string>;
-    Dict *headerData = static_cast<Dict *>(userdata);
-    size_t len       = size * nitems;
-
-    std::string headerLine(buffer, len);
-    std::vector<std::string> headerLineParts;
-    boost::split(headerLineParts,
-                 headerLine,
-                 boost::is_any_of("\n "),
-                 boost::token_compress_on);
-    if (headerLineParts.size() >= 2 &&
-        boost::find_first(headerLineParts[0], "Location")) {
-        auto &locValue = headerLineParts[1];
-        boost::trim(locValue);
-        (*headerData)["Location"] = locValue;
-    }
+    auto headerData = static_cast<HttpResponse::HeaderDict *>(userdata);
+    size_t len      = size * nitems;
+    parseHeaderLine(buffer, len, *headerData);
     return len;
 }
 
@@ -101,7 +104,8 @@ HttpSession::~HttpSession()
 }
 
 HttpSession::HttpSession(HttpSession &&other)
-    : handle(other.handle), currentHeaderNode(other.currentHeaderNode),
+    : handle(other.handle), share(other.share),
+      currentHeaderNode(other.currentHeaderNode),
       dataCallback(std::move(other.dataCallback))
 {
     other.handle            = nullptr;
@@ -111,6 +115,7 @@ HttpSession::HttpSession(HttpSession &&other)
 HttpSession &HttpSession::operator=(HttpSession &&other)
 {
     handle                  = other.handle;
+    share                   = other.share;
     currentHeaderNode       = other.currentHeaderNode;
     dataCallback            = std::move(other.dataCallback);
     other.handle            = nullptr;
@@ -130,12 +135,42 @@ void HttpSession::setHeaderParam(const std::string &key,
     curl_easy_setopt(handle, CURLOPT_HTTPHEADER, currentHeaderNode);
 }
 
+void HttpSession::setShare(HttpShare *share)
+{
+    this->share = share;
+    curl_easy_setopt(
+        handle, CURLOPT_SHARE, share ? share->getHandle() : nullptr);
+}
+
+// Valid from the first data callback on, once the headers are in.
+long HttpSession::getStatusCode() const
+{
+    long statusCode = 0;
+    curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &statusCode);
+    return statusCode;
+}
+
+// Length of the body being received, or -1 while it is not known.
+long long HttpSession::getContentLength() const
+{
+    curl_off_t length = -1;
+    curl_easy_getinfo(handle, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length);
+    return static_cast<long long>(length);
+}
+
 void HttpSession::setByteRange(long minValue)
 {
     std::string minValueStr = std::to_string(minValue);
     curl_easy_setopt(handle, CURLOPT_RANGE, (minValueStr + "-").c_str());
 }
 
+void HttpSession::setByteRange(long minValue, long maxValue)
+{
+    std::string range =
+        std::to_string(minValue) + "-" + std::to_string(maxValue);
+    curl_easy_setopt(handle, CURLOPT_RANGE, range.c_str());
+}
+
 HttpResponse HttpSession::makeRequest(const HttpRequest &request)
 {
     std::lock_guard<std::mutex> lock{mutex};
@@ -167,7 +202,7 @@ HttpResponse HttpSession::makeRequest(const HttpRequest &request)
     }
 
     std::string responseText;
-    std::map<std::string, std::string> headerData;
+    HttpResponse::HeaderDict headerData;
     curl_easy_setopt(handle, CURLOPT_URL, requestUrl.c_str());
     if (dataCallback) {
         curl_easy_setopt(handle, CURLOPT_WRITEDATA, this);
@@ -184,7 +219,28 @@ HttpResponse HttpSession::makeRequest(const HttpRequest &request)
     curl_easy_setopt(handle, CURLOPT_HEADERDATA, &headerData);
     curl_easy_setopt(handle, CURLOPT_HEADERFUNCTION, header_callback);
 
+    // Request headers go after the session ones, on a list that only lives
+    // for this request.
+    struct curl_slist *requestHeaders = nullptr;
+    if (!request.getHeaders().empty()) {
+        for (auto node = currentHeaderNode; node; node = node->next) {
+            requestHeaders = curl_slist_append(requestHeaders, node->data);
+        }
+        for (auto &header : request.getHeaders()) {
+            auto line      = header.first + ": " + header.second;
+            requestHeaders = curl_slist_append(requestHeaders, line.c_str());
+        }
+        curl_easy_setopt(handle, CURLOPT_HTTPHEADER, requestHeaders);
+    }
+
     CURLcode result = curl_easy_perform(handle);
+    if (requestHeaders != nullptr) {
+        curl_easy_setopt(handle, CURLOPT_HTTPHEADER, currentHeaderNode);
+        curl_slist_free_all(requestHeaders);
+    }
+    if (share != nullptr && result == CURLE_OK) {
+        share->recordTransfer(handle);
+    }
 
     long statusCode;
     char *url;
@@ -1,6 +1,7 @@
 #ifndef HTTPCLIENT_HPP_
 #define HTTPCLIENT_HPP_
 
+#include <boost/algorithm/string/predicate.hpp>
 #include <curl/curl.h>
 #include <functional>
 #include <map>
@@ -11,6 +12,7 @@
 #include <vector>
 
 #include "http/httperror.hpp"
+#include "http/http-share.hpp"
 
 namespace gmusic
 {
@@ -33,20 +35,35 @@ class HttpRequest
     void setBody(std::string &&body) { this->body = std::move(body); }
     void setBody(const std::vector<KVPair> &pairs);
 
+    void addHeader(const std::string &key, const std::string &value)
+    {
+        headers.emplace_back(key, value);
+    }
+
     std::string getParamString() const { return paramString; }
     std::string getBody() const { return body; }
     HttpMethod getMethod() const { return method; }
     std::string getUrl() const { return url; }
+    const std::vector<KVPair> &getHeaders() const { return headers; }
 
   private:
     std::string paramString;
     std::string body;
+    std::vector<KVPair> headers;
     HttpMethod method;
     std::string url;
 };
 
+// Header names are case-insensitive, and HTTP/2 sends them in lower case.
+struct CaseInsensitiveLess {
+    bool operator()(const std::string &lhs, const std::string &rhs) const
+    {
+        return boost::algorithm::ilexicographical_compare(lhs, rhs);
+    }
+};
+
 struct HttpResponse {
-    using HeaderDict = std::map<std::string, std::string>;
+    using HeaderDict = std::map<std::string, std::string, CaseInsensitiveLess>;
     HttpResponse(long statusCode,
                  std::string url,
                  HeaderDict headerDict,
@@ -66,6 +83,12 @@ struct HttpResponse {
 
 enum class HttpHeaderKey { USER_AGENT };
 
+// Adds a "Name: value" header line to headers. A status line clears them,
+// so after redirects and interim replies only the final ones are kept.
+void parseHeaderLine(const char *data,
+                     size_t length,
+                     HttpResponse::HeaderDict &headers);
+
 // class WorkerScheduler;
 // class HttpSessionPrivate;
 
@@ -87,6 +110,10 @@ class HttpSession
     void resume();
     void setHeaderParam(const std::string &key, const std::string &value);
     void setByteRange(long minValue);
+    void setByteRange(long minValue, long maxValue);
+    void setShare(HttpShare *share);
+    long getStatusCode() const;
+    long long getContentLength() const;
 
     void
     setDataCallback(const std::function<size_t(char *, size_t)> &dataCallback)
@@ -112,13 +139,17 @@ class HttpSession
         return progressCallback;
     }
 
-    static HttpResponse performRequest(const HttpRequest &request)
+    static HttpResponse performRequest(const HttpRequest &request,
+                                       HttpShare *share = nullptr)
     {
-        return HttpSession().makeRequest(request);
+        HttpSession session;
+        session.setShare(share);
+        return session.makeRequest(request);
     }
 
   private:
     CURL *handle;
+    HttpShare *share = nullptr;
     std::mutex mutex;
     struct curl_slist *currentHeaderNode = nullptr;
     std::function<size_t(char *, size_t)> dataCallback;
@@ -0,0 +1,299 @@
+#include "http/response-cache.hpp"
+#include "utilities.hpp"
+
+#include <boost/algorithm/string.hpp>
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <sstream>
+#include <vector>
+
+namespace gmusic
+{
+
+namespace fs = boost::filesystem;
+
+ResponseCache::ResponseCache(const std::string &directory,
+                             long ttlSec,
+                             uint64_t capacity)
+    : directory{directory}, ttlSec{ttlSec}, capacity{capacity}
+{
+    boost::system::error_code error;
+    fs::create_directories(directory + "/meta", error);
+    fs::create_directories(directory + "/blobs", error);
+    if (error) {
+        ERRLOG << "response cache disabled: " << error.message() << std::endl;
+        return;
+    }
+    prune(capacity);
+}
+
+std::string ResponseCache::keyFor(const HttpRequest &request)
+{
+    auto params = request.getParamString();
+    return params.empty() ? request.getUrl() : request.getUrl() + "?" + params;
+}
+
+std::string ResponseCache::metaPath(const std::string &key) const
+{
+    return directory + "/meta/" + CryptoUtils::sha1Hex(key);
+}
+
+std::string ResponseCache::blobPath(const std::string &blob) const
+{
+    return directory + "/blobs/" + blob;
+}
+
+bool ResponseCache::readEntryFile(const std::string &path, Entry &entry)
+{
+    std::ifstream in(path);
+    std::string maxAge;
+    std::string expiresAt;
+    if (!std::getline(in, entry.url) || !std::getline(in, entry.blob) ||
+        !std::getline(in, entry.etag) ||
+        !std::getline(in, entry.lastModified) || !std::getline(in, maxAge) ||
+        !std::getline(in, expiresAt)) {
+        return false;
+    }
+    entry.maxAge =
+        static_cast<long>(StringUtils::unsignedLongFromString(maxAge));
+    entry.expiresAt = static_cast<std::time_t>(
+        StringUtils::unsignedLongFromString(expiresAt));
+    return true;
+}
+
+bool ResponseCache::readEntry(const std::string &key, Entry &entry) const
+{
+    // Two urls hashing alike is not expected, but a mismatch is a miss.
+    return readEntryFile(metaPath(key), entry) && entry.url == key;
+}
+
+void ResponseCache::writeEntry(const std::string &key,
+                               const Entry &entry) const
+{
+    std::ostringstream out;
+    out << entry.url << '\n'
+        << entry.blob << '\n'
+        << entry.etag << '\n'
+        << entry.lastModified << '\n'
+        << entry.maxAge << '\n'
+        << entry.expiresAt << '\n';
+    if (!FSUtils::writeFileAtomically(metaPath(key), out.str())) {
+        ERRLOG << "response cache: failed to write entry for " << key
+               << std::endl;
+    }
+}
+
+bool ResponseCache::readBlob(const std::string &blob, std::string &text) const
+{
+    std::ifstream in(blobPath(blob), std::ios::binary);
+    if (!in) {
+        return false;
+    }
+    text.assign(std::istreambuf_iterator<char>(in),
+                std::istreambuf_iterator<char>());
+    return true;
+}
+
+// Seconds the response stays fresh according to Cache-Control, or
+// fallback when the server does not say. Negative if it must not be stored.
+long ResponseCache::maxAgeFor(const HttpResponse &response, long fallback)
+{
+    auto cacheCtl = response.headerDict.find("Cache-Control");
+    if (cacheCtl == response.headerDict.end()) {
+        return fallback;
+    }
+    auto value = boost::to_lower_copy(cacheCtl->second);
+    if (boost::contains(value, "no-store")) {
+        return -1;
+    }
+    if (boost::contains(value, "no-cache")) {
+        return 0;
+    }
+    auto maxAge = value.find("max-age=");
+    if (maxAge == std::string::npos) {
+        return fallback;
+    }
+    return static_cast<long>(
+        StringUtils::unsignedLongFromString(value.substr(maxAge + 8)));
+}
+
+void ResponseCache::store(const std::string &key, const HttpResponse &response)
+{
+    Entry entry;
+    entry.maxAge = maxAgeFor(response, ttlSec);
+    if (entry.maxAge < 0) {
+        return;
+    }
+    entry.expiresAt = std::time(nullptr) + entry.maxAge;
+    entry.url       = key;
+    entry.blob = CryptoUtils::sha1Hex(response.text);
+
+    auto etag = response.headerDict.find("ETag");
+    if (etag != response.headerDict.end()) {
+        entry.etag = etag->second;
+    }
+    auto lastModified = response.headerDict.find("Last-Modified");
+    if (lastModified != response.headerDict.end()) {
+        entry.lastModified = lastModified->second;
+    }
+
+    if (!fs::exists(blobPath(entry.blob))) {
+        if (!FSUtils::writeFileAtomically(blobPath(entry.blob),
+                                          response.text)) {
+            ERRLOG << "response cache: failed to write body of " << key
+                   << std::endl;
+            return;
+        }
+        stats.bytesUsed += response.text.size();
+    }
+    writeEntry(key, entry);
+    ++stats.stored;
+
+    if (stats.bytesUsed > capacity) {
+        prune(capacity - capacity / 4);
+    }
+}
+
+// Goes through every entry and blob on disk, so it runs only when the
+// cache opens and when it has grown past its capacity.
+void ResponseCache::prune(uint64_t target)
+{
+    struct UsedEntry {
+        std::time_t usedAt;
+        fs::path path;
+        std::string blob;
+    };
+    std::vector<UsedEntry> used;
+    std::map<std::string, int> references;
+    auto now = std::time(nullptr);
+
+    boost::system::error_code error;
+    for (fs::directory_iterator it(directory + "/meta", error), end;
+         !error && it != end;
+         it.increment(error)) {
+        boost::system::error_code fileError;
+        Entry entry;
+        if (!readEntryFile(it->path().string(), entry) ||
+            entry.expiresAt + ttlSec < now) {
+            fs::remove(it->path(), fileError);
+            ++stats.evictions;
+            continue;
+        }
+        used.push_back({fs::last_write_time(it->path(), fileError),
+                        it->path(),
+                        entry.blob});
+        ++references[entry.blob];
+    }
+
+    std::map<std::string, uint64_t> blobSizes;
+    stats.bytesUsed = 0;
+    for (fs::directory_iterator it(directory + "/blobs", error), end;
+         !error && it != end;
+         it.increment(error)) {
+        boost::system::error_code fileError;
+        auto blob = it->path().filename().string();
+        if (references.count(blob) == 0) {
+            fs::remove(it->path(), fileError);
+            continue;
+        }
+        auto size = fs::file_size(it->path(), fileError);
+        if (!fileError) {
+            blobSizes[blob] = size;
+            stats.bytesUsed += size;
+        }
+    }
+
+    std::sort(used.begin(),
+              used.end(),
+              [](const UsedEntry &a, const UsedEntry &b) {
+                  return a.usedAt < b.usedAt;
+              });
+    for (const auto &entry : used) {
+        if (stats.bytesUsed <= target) {
+            break;
+        }
+        fs::remove(entry.path, error);
+        ++stats.evictions;
+        if (--references[entry.blob] == 0) {
+            fs::remove(blobPath(entry.blob), error);
+            stats.bytesUsed -= blobSizes[entry.blob];
+        }
+    }
+}
+
+boost::optional<HttpResponse> ResponseCache::lookup(HttpRequest &request)
+{
+    if (request.getMethod() != HttpMethod::GET) {
+        return boost::none;
+    }
+    auto key = keyFor(request);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    ++stats.lookups;
+    Entry entry;
+    std::string text;
+    if (!readEntry(key, entry) || !readBlob(entry.blob, text)) {
+        return boost::none;
+    }
+    if (std::time(nullptr) < entry.expiresAt) {
+        // The entry's modification time is its last use for pruning.
+        boost::system::error_code error;
+        fs::last_write_time(metaPath(key), std::time(nullptr), error);
+        ++stats.hits;
+        stats.bytesSaved += text.size();
+        return HttpResponse(200, entry.url, HttpResponse::HeaderDict(), text);
+    }
+
+    if (!entry.etag.empty()) {
+        request.addHeader("If-None-Match", entry.etag);
+    }
+    if (!entry.lastModified.empty()) {
+        request.addHeader("If-Modified-Since", entry.lastModified);
+    }
+    return boost::none;
+}
+
+HttpResponse ResponseCache::update(const HttpRequest &request,
+                                   HttpResponse response)
+{
+    if (request.getMethod() != HttpMethod::GET) {
+        return response;
+    }
+    auto key = keyFor(request);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (response.error.code == HttpErrorCode::OK && response.status == 304) {
+        Entry entry;
+        std::string text;
+        if (readEntry(key, entry) && readBlob(entry.blob, text)) {
+            ++stats.revalidated;
+            stats.bytesSaved += text.size();
+            // A 304 without Cache-Control keeps the stored lifetime.
+            auto maxAge = maxAgeFor(response, entry.maxAge);
+            if (maxAge >= 0) {
+                entry.maxAge    = maxAge;
+                entry.expiresAt = std::time(nullptr) + maxAge;
+                writeEntry(key, entry);
+            }
+            response.status = 200;
+            response.text   = std::move(text);
+            return response;
+        }
+    }
+
+    ++stats.misses;
+    if (response.error.code == HttpErrorCode::OK && response.status == 200) {
+        store(key, response);
+    }
+    return response;
+}
+
+ResponseCacheStats ResponseCache::getStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+}
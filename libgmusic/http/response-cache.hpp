@@ -0,0 +1,86 @@
+#ifndef RESPONSE_CACHE_HPP
+#define RESPONSE_CACHE_HPP
+
+#include <boost/optional.hpp>
+#include <cstdint>
+#include <ctime>
+#include <mutex>
+#include <string>
+
+#include "http/httpsession.hpp"
+
+namespace gmusic
+{
+
+struct ResponseCacheStats {
+    uint64_t lookups     = 0;
+    uint64_t hits        = 0;
+    uint64_t revalidated = 0;
+    uint64_t misses      = 0;
+    uint64_t stored      = 0;
+    uint64_t evictions   = 0;
+    uint64_t bytesSaved  = 0;
+    uint64_t bytesUsed   = 0;
+
+    double hitRate() const
+    {
+        return lookups > 0 ? double(hits + revalidated) / lookups : 0.0;
+    }
+};
+
+// On-disk cache of GET responses. Bodies are stored once under the SHA-1
+// of their content in blobs/, and each request URL has an entry in meta/
+// with the blob, the ETag and Last-Modified validators and an expiry time.
+//
+// A fresh entry is served without a request. A stale one adds conditional
+// headers to the request, and a 304 reply is served from the blob.
+//
+// Entries that have been stale for another ttlSec are dropped. When the
+// blobs outgrow the capacity, the least recently used entries are dropped
+// until they take three quarters of it. Blobs no entry refers to go with
+// them.
+class ResponseCache
+{
+  public:
+    static const long defaultTtlSec       = 7 * 24 * 3600;
+    static const uint64_t defaultCapacity = 64 * 1024 * 1024;
+
+    ResponseCache(const std::string &directory,
+                  long ttlSec       = defaultTtlSec,
+                  uint64_t capacity = defaultCapacity);
+
+    boost::optional<HttpResponse> lookup(HttpRequest &request);
+    HttpResponse update(const HttpRequest &request, HttpResponse response);
+
+    ResponseCacheStats getStats() const;
+
+  private:
+    struct Entry {
+        std::string url;
+        std::string blob;
+        std::string etag;
+        std::string lastModified;
+        long maxAge           = 0;
+        std::time_t expiresAt = 0;
+    };
+
+    static std::string keyFor(const HttpRequest &request);
+    std::string metaPath(const std::string &key) const;
+    std::string blobPath(const std::string &blob) const;
+    static bool readEntryFile(const std::string &path, Entry &entry);
+    bool readEntry(const std::string &key, Entry &entry) const;
+    void writeEntry(const std::string &key, const Entry &entry) const;
+    bool readBlob(const std::string &blob, std::string &text) const;
+    void store(const std::string &key, const HttpResponse &response);
+    static long maxAgeFor(const HttpResponse &response, long fallback);
+    void prune(uint64_t target);
+
+    std::string directory;
+    long ttlSec;
+    uint64_t capacity;
+    mutable std::mutex mutex;
+    ResponseCacheStats stats;
+};
+}
+
+#endif // RESPONSE_CACHE_HPP
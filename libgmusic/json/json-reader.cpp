@@ -0,0 +1,333 @@
+#include "json/json-reader.hpp"
+
+namespace gmusic
+{
+namespace json
+{
+
+void JsonReader::fail(const char *what) const
+{
+    throw JsonException(std::string("JSON: ") + what + " at offset " +
+                        std::to_string(pos));
+}
+
+void JsonReader::skipWhitespace()
+{
+    while (pos < text.size()) {
+        char c = text[pos];
+        if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+            return;
+        }
+        ++pos;
+    }
+}
+
+void JsonReader::expect(char c)
+{
+    if (!consume(c)) {
+        fail(pos < text.size() ? "unexpected character" : "unexpected end");
+    }
+}
+
+bool JsonReader::consume(char c)
+{
+    skipWhitespace();
+    if (pos < text.size() && text[pos] == c) {
+        ++pos;
+        return true;
+    }
+    return false;
+}
+
+ValueType JsonReader::peek()
+{
+    skipWhitespace();
+    if (pos >= text.size()) {
+        fail("unexpected end");
+    }
+    switch (text[pos]) {
+    case '{':
+        return ValueType::Object;
+    case '[':
+        return ValueType::Array;
+    case '"':
+        return ValueType::String;
+    case 't':
+    case 'f':
+        return ValueType::Bool;
+    case 'n':
+        return ValueType::Null;
+    default:
+        return ValueType::Number;
+    }
+}
+
+static void appendUtf8(std::string &buffer, uint32_t codePoint)
+{
+    if (codePoint < 0x80) {
+        buffer += static_cast<char>(codePoint);
+    } else if (codePoint < 0x800) {
+        buffer += static_cast<char>(0xC0 | (codePoint >> 6));
+        buffer += static_cast<char>(0x80 | (codePoint & 0x3F));
+    } else if (codePoint < 0x10000) {
+        buffer += static_cast<char>(0xE0 | (codePoint >> 12));
+        buffer += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+        buffer += static_cast<char>(0x80 | (codePoint & 0x3F));
+    } else {
+        buffer += static_cast<char>(0xF0 | (codePoint >> 18));
+        buffer += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+        buffer += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+        buffer += static_cast<char>(0x80 | (codePoint & 0x3F));
+    }
+}
+
+static int hexValue(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+void JsonReader::appendEscape(std::string &buffer)
+{
+    if (pos >= text.size()) {
+        fail("unexpected end");
+    }
+    char c = text[pos++];
+    switch (c) {
+    case '"':
+    case '\\':
+    case '/':
+        buffer += c;
+        return;
+    case 'b':
+        buffer += '\b';
+        return;
+    case 'f':
+        buffer += '\f';
+        return;
+    case 'n':
+        buffer += '\n';
+        return;
+    case 'r':
+        buffer += '\r';
+        return;
+    case 't':
+        buffer += '\t';
+        return;
+    case 'u':
+        break;
+    default:
+        fail("invalid escape");
+    }
+
+    auto readHex4 = [this]() -> uint32_t {
+        if (text.size() - pos < 4) {
+            fail("unexpected end");
+        }
+        uint32_t value = 0;
+        for (int i = 0; i < 4; ++i) {
+            int digit = hexValue(text[pos++]);
+            if (digit < 0) {
+                fail("invalid unicode escape");
+            }
+            value = (value << 4) | static_cast<uint32_t>(digit);
+        }
+        return value;
+    };
+
+    uint32_t codePoint = readHex4();
+    if (codePoint >= 0xD800 && codePoint < 0xDC00 &&
+        text.substr(pos, 2) == "\\u") {
+        auto mark = pos;
+        pos += 2;
+        uint32_t low = readHex4();
+        if (low >= 0xDC00 && low < 0xE000) {
+            codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+        } else {
+            pos = mark;
+        }
+    }
+    if (codePoint >= 0xD800 && codePoint < 0xE000) {
+        // An unpaired surrogate has no UTF-8 form.
+        codePoint = 0xFFFD;
+    }
+    appendUtf8(buffer, codePoint);
+}
+
+// Returns a view into the document when the string has no escapes, and
+// into the buffer otherwise.
+boost::string_view JsonReader::readRawString(std::string &buffer)
+{
+    expect('"');
+    auto start = pos;
+    while (pos < text.size() && text[pos] != '"' && text[pos] != '\\') {
+        ++pos;
+    }
+    if (pos >= text.size()) {
+        fail("unterminated string");
+    }
+    if (text[pos] == '"') {
+        return text.substr(start, pos++ - start);
+    }
+
+    buffer.assign(text.data() + start, pos - start);
+    while (pos < text.size()) {
+        char c = text[pos++];
+        if (c == '"') {
+            return buffer;
+        }
+        if (c == '\\') {
+            appendEscape(buffer);
+        } else {
+            buffer += c;
+        }
+    }
+    fail("unterminated string");
+}
+
+void JsonReader::enter()
+{
+    if (++depth > maxDepth) {
+        fail("nesting too deep");
+    }
+}
+
+boost::string_view JsonReader::readKey() { return readRawString(keyBuffer); }
+
+void JsonReader::readString(std::string &value)
+{
+    if (peek() == ValueType::String) {
+        auto raw = readRawString(valueBuffer);
+        value.assign(raw.data(), raw.size());
+    } else if (peek() == ValueType::Number) {
+        auto raw = readNumberToken();
+        value.assign(raw.data(), raw.size());
+    } else if (!readNull()) {
+        fail("string expected");
+    }
+}
+
+std::string JsonReader::readString()
+{
+    std::string value;
+    readString(value);
+    return value;
+}
+
+boost::string_view JsonReader::readNumberToken()
+{
+    skipWhitespace();
+    auto start = pos;
+    while (pos < text.size()) {
+        char c = text[pos];
+        if ((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' ||
+            c == 'e' || c == 'E') {
+            ++pos;
+        } else {
+            break;
+        }
+    }
+    if (pos == start) {
+        fail("number expected");
+    }
+    return text.substr(start, pos - start);
+}
+
+// The API sends many integers as strings, so both forms are accepted.
+// Fractions are truncated.
+int64_t JsonReader::readInt()
+{
+    boost::string_view token;
+    switch (peek()) {
+    case ValueType::String:
+        token = readRawString(valueBuffer);
+        break;
+    case ValueType::Number:
+        token = readNumberToken();
+        break;
+    case ValueType::Null:
+        readNull();
+        return 0;
+    default:
+        fail("number expected");
+    }
+
+    size_t i      = 0;
+    bool negative = false;
+    if (i < token.size() && (token[i] == '-' || token[i] == '+')) {
+        negative = token[i] == '-';
+        ++i;
+    }
+    int64_t value = 0;
+    for (; i < token.size() && token[i] >= '0' && token[i] <= '9'; ++i) {
+        value = value * 10 + (token[i] - '0');
+    }
+    return negative ? -value : value;
+}
+
+uint64_t JsonReader::readUnsigned()
+{
+    auto value = readInt();
+    return value < 0 ? 0 : static_cast<uint64_t>(value);
+}
+
+bool JsonReader::readBool()
+{
+    skipWhitespace();
+    if (text.substr(pos, 4) == "true") {
+        pos += 4;
+        return true;
+    }
+    if (text.substr(pos, 5) == "false") {
+        pos += 5;
+        return false;
+    }
+    if (peek() == ValueType::String) {
+        return readRawString(valueBuffer) == "true";
+    }
+    fail("boolean expected");
+}
+
+bool JsonReader::readNull()
+{
+    skipWhitespace();
+    if (text.substr(pos, 4) == "null") {
+        pos += 4;
+        return true;
+    }
+    return false;
+}
+
+void JsonReader::skipValue()
+{
+    switch (peek()) {
+    case ValueType::Object:
+        readObject([this](boost::string_view) { skipValue(); });
+        break;
+    case ValueType::Array:
+        readArray([this] { skipValue(); });
+        break;
+    case ValueType::String:
+        readRawString(valueBuffer);
+        break;
+    case ValueType::Bool:
+        readBool();
+        break;
+    case ValueType::Null:
+        readNull();
+        break;
+    case ValueType::Number:
+        readNumberToken();
+        break;
+    }
+}
+}
+}
@@ -0,0 +1,92 @@
+#ifndef JSON_READER_HPP
+#define JSON_READER_HPP
+
+#include <boost/utility/string_view.hpp>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+namespace gmusic
+{
+namespace json
+{
+
+struct JsonException : public std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+enum class ValueType { Null, Bool, Number, String, Array, Object };
+
+// Streaming reader over a JSON document. Values are consumed in document
+// order and decoded straight into the caller's variables; no tree is built.
+// Object keys passed to handlers stay valid until the next read. Documents
+// nested deeper than maxDepth are rejected rather than recursed into.
+class JsonReader
+{
+  public:
+    static const int maxDepth = 256;
+
+    explicit JsonReader(boost::string_view text) : text(text) {}
+
+    ValueType peek();
+
+    template <class Handler> void readObject(Handler &&onMember);
+    template <class Handler> void readArray(Handler &&onElement);
+
+    void readString(std::string &value);
+    std::string readString();
+    int64_t readInt();
+    uint64_t readUnsigned();
+    bool readBool();
+    bool readNull();
+    void skipValue();
+
+  private:
+    void skipWhitespace();
+    void enter();
+    void expect(char c);
+    bool consume(char c);
+    boost::string_view readKey();
+    boost::string_view readRawString(std::string &buffer);
+    boost::string_view readNumberToken();
+    void appendEscape(std::string &buffer);
+    [[noreturn]] void fail(const char *what) const;
+
+    boost::string_view text;
+    size_t pos = 0;
+    int depth  = 0;
+    std::string keyBuffer;
+    std::string valueBuffer;
+};
+
+template <class Handler> void JsonReader::readObject(Handler &&onMember)
+{
+    expect('{');
+    enter();
+    if (!consume('}')) {
+        do {
+            auto key = readKey();
+            expect(':');
+            onMember(key);
+        } while (consume(','));
+        expect('}');
+    }
+    --depth;
+}
+
+template <class Handler> void JsonReader::readArray(Handler &&onElement)
+{
+    expect('[');
+    enter();
+    if (!consume(']')) {
+        do {
+            onElement();
+        } while (consume(','));
+        expect(']');
+    }
+    --depth;
+}
+}
+}
+
+#endif // JSON_READER_HPP
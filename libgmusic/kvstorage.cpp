@@ -23,6 +23,7 @@ KeyValueStorage::~KeyValueStorage() { sync(); }
 
 bool KeyValueStorage::removeKey(const std::string &key)
 {
+    std::lock_guard<std::mutex> lock(mutex);
     auto &userStorage = getUserStorage();
     auto result       = userStorage.find(key);
     if (result != userStorage.not_found()) {
@@ -34,6 +35,7 @@ bool KeyValueStorage::removeKey(const std::string &key)
 
 bool KeyValueStorage::sync()
 {
+    std::lock_guard<std::mutex> lock(mutex);
     try {
         pt::write_ini(keyFileName, ptree);
         return true;
@@ -3,6 +3,7 @@
 
 #include <boost/optional.hpp>
 #include <boost/property_tree/ptree.hpp>
+#include <mutex>
 #include <string>
 
 namespace gmusic
@@ -16,11 +17,13 @@ class KeyValueStorage
 
     template <class T> void saveValueForKey(T &&value, const std::string &key)
     {
+        std::lock_guard<std::mutex> lock(mutex);
         getUserStorage().put(key, value);
     }
 
     template <class T> boost::optional<T> getValueForKey(const std::string &key)
     {
+        std::lock_guard<std::mutex> lock(mutex);
         return getUserStorage().get_optional<T>(key);
     }
 
@@ -36,6 +39,7 @@ class KeyValueStorage
   private:
     boost::property_tree::ptree ptree;
     std::string keyFileName;
+    std::mutex mutex;
 };
 }
 
@@ -2,15 +2,20 @@
 //#include <iostream>
 #include "utilities.hpp"
 
+#include <algorithm>
+
 namespace gmusic
 {
 
 BaseTask::~BaseTask() = default;
 
-OperationQueue::OperationQueue()
-    : workerThread(&OperationQueue::workerRoutine, this)
+OperationQueue::OperationQueue(size_t workersCount)
 {
     STDLOG << "OperationQueue ctor" << std::endl;
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < std::max<size_t>(workersCount, 1); ++i) {
+        workers.emplace_back(&OperationQueue::workerRoutine, this);
+    }
 }
 
 OperationQueue::~OperationQueue()
@@ -19,59 +24,166 @@ OperationQueue::~OperationQueue()
     shutdown();
 }
 
+bool OperationQueue::isWorker() const
+{
+    auto id = std::this_thread::get_id();
+    return std::any_of(workers.begin(),
+                       workers.end(),
+                       [id](const std::thread &worker) {
+                           return worker.get_id() == id;
+                       });
+}
+
 void OperationQueue::wait()
 {
-    std::unique_lock<std::recursive_mutex> lock(mutex);
+    std::unique_lock<std::mutex> lock(mutex);
+    if (isWorker()) {
+        return;
+    }
+    finished.wait(lock, [this] {
+        return stopping || (queue.empty() && runningCount == 0);
+    });
+}
+
+void OperationQueue::push(TaskPackage &&package)
+{
+    queue.push_back(std::move(package));
+    stats.queueDepth    = queue.size();
+    stats.maxQueueDepth = std::max(stats.maxQueueDepth, queue.size());
+    hasWork.notify_one();
 }
 
 void OperationQueue::workerRoutine()
 {
+    using namespace std::chrono;
+
+    std::unique_lock<std::mutex> lock(mutex);
     while (true) {
-        std::unique_lock<std::recursive_mutex> lock{mutex};
-        while (queue.empty() && !cancellationFlag) {
-            condvar.wait(lock);
-        }
-        if (cancellationFlag) {
+        hasWork.wait(lock, [this] { return stopping || !queue.empty(); });
+        if (stopping) {
             return;
         }
-        while (!queue.empty()) {
-            auto &taskPackage = queue.front();
-            if (tokens.find(taskPackage.second) != tokens.end()) {
-                taskPackage.first();
+        TaskPackage package = std::move(queue.front());
+        queue.pop_front();
+        ++runningCount;
+        stats.queueDepth = queue.size();
+        tokens[package.token].runningOn = std::this_thread::get_id();
+
+        auto start  = Clock::now();
+        auto waitUs = static_cast<uint64_t>(
+            duration_cast<microseconds>(start - package.scheduledAt).count());
+        stats.waitTimeUs += waitUs;
+        stats.maxWaitUs = std::max(stats.maxWaitUs, waitUs);
+        lock.unlock();
+
+        try {
+            package.routine();
+        } catch (const std::exception &exc) {
+            ERRLOG << "OperationQueue: task failed: " << exc.what()
+                   << std::endl;
+        } catch (...) {
+            ERRLOG << "OperationQueue: task failed" << std::endl;
+        }
+        package.routine = nullptr;
+
+        auto runUs = static_cast<uint64_t>(
+            duration_cast<microseconds>(Clock::now() - start).count());
+        lock.lock();
+        ++stats.executed;
+        stats.runTimeUs += runUs;
+        stats.maxRunUs = std::max(stats.maxRunUs, runUs);
+        --runningCount;
+
+        auto tokenIter = tokens.find(package.token);
+        if (tokenIter != tokens.end()) {
+            auto &state     = tokenIter->second;
+            state.runningOn = std::thread::id();
+            if (state.pending.empty()) {
+                state.queued = false;
+            } else {
+                push(std::move(state.pending.front()));
+                state.pending.pop_front();
             }
-            queue.pop();
         }
+        finished.notify_all();
     }
 }
 
 void OperationQueue::scheduleTask(const TaskRoutine &routine, void *token)
 {
-    std::unique_lock<std::recursive_mutex> lock(mutex);
-    tokens.insert(token);
-    auto pair = std::make_pair(std::move(routine), token);
-    queue.push(std::move(pair));
-    lock.unlock();
-    condvar.notify_one();
+    std::lock_guard<std::mutex> lock(mutex);
+    ++stats.scheduled;
+    auto &state = tokens[token];
+    TaskPackage package{routine, token, Clock::now()};
+    if (state.queued) {
+        state.pending.push_back(std::move(package));
+    } else {
+        state.queued = true;
+        push(std::move(package));
+    }
 }
 
 void OperationQueue::unregister(void *token)
 {
-    std::unique_lock<std::recursive_mutex> lock(mutex);
+    std::unique_lock<std::mutex> lock(mutex);
     auto tokenIter = tokens.find(token);
-    if (tokenIter != tokens.end()) {
+    if (tokenIter == tokens.end()) {
+        return;
+    }
+    stats.cancelled += tokenIter->second.pending.size();
+    tokenIter->second.pending.clear();
+    auto oldSize = queue.size();
+    queue.erase(std::remove_if(queue.begin(),
+                               queue.end(),
+                               [token](const TaskPackage &package) {
+                                   return package.token == token;
+                               }),
+                queue.end());
+    stats.cancelled += oldSize - queue.size();
+    stats.queueDepth = queue.size();
+    if (oldSize != queue.size()) {
+        tokenIter->second.queued = false;
+    }
+
+    // A task may drop its own token; it must not wait for itself. Its state
+    // stays until it returns, so tasks scheduled meanwhile queue behind it.
+    auto self = std::this_thread::get_id();
+    if (tokenIter->second.runningOn == self) {
+        return;
+    }
+    finished.wait(lock, [this, token] {
+        auto iter = tokens.find(token);
+        return iter == tokens.end() ||
+               iter->second.runningOn == std::thread::id();
+    });
+    // Tasks scheduled while waiting keep the token in use.
+    tokenIter = tokens.find(token);
+    if (tokenIter != tokens.end() && !tokenIter->second.queued) {
         tokens.erase(tokenIter);
     }
+    finished.notify_all();
 }
 
 void OperationQueue::shutdown()
 {
-    if (workerThread.joinable()) {
-        cancellationFlag = true;
-        condvar.notify_one();
-        workerThread.join();
+    std::unique_lock<std::mutex> lock(mutex);
+    stopping = true;
+    lock.unlock();
+    hasWork.notify_all();
+    finished.notify_all();
+    for (auto &worker : workers) {
+        if (worker.joinable()) {
+            worker.join();
+        }
     }
 }
 
+OperationQueueStats OperationQueue::getStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
 RWLockHandle::RWLockHandle() : activeReaders(0), activeWriters(0)
 {
     STDLOG << "RWLockHandle init" << std::endl;
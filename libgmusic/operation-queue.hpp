@@ -2,7 +2,10 @@
 #define OPERATION_QUEUE_HPP
 
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <cstdint>
+#include <deque>
 #include <functional>
 #include <future>
 #include <map>
@@ -11,17 +14,38 @@
 #include <set>
 #include <thread>
 #include <type_traits>
+#include <vector>
 
 namespace gmusic
 {
 
+struct OperationQueueStats {
+    uint64_t scheduled   = 0;
+    uint64_t executed    = 0;
+    uint64_t cancelled   = 0;
+    size_t queueDepth    = 0;
+    size_t maxQueueDepth = 0;
+    uint64_t waitTimeUs  = 0;
+    uint64_t maxWaitUs   = 0;
+    uint64_t runTimeUs   = 0;
+    uint64_t maxRunUs    = 0;
+
+    uint64_t averageWaitUs() const
+    {
+        return executed == 0 ? 0 : waitTimeUs / executed;
+    }
+};
+
+// Runs tasks on a fixed set of workers that share one FIFO queue. Tasks
+// sharing a token run one at a time in the order they were scheduled, even
+// across unregister(), which drops the queued ones and waits for the running
+// one.
 class OperationQueue
 {
   public:
     using TaskRoutine = std::function<void(void)>;
-    using TaskPackage = std::pair<TaskRoutine, void *>;
 
-    OperationQueue();
+    explicit OperationQueue(size_t workersCount = 1);
     ~OperationQueue();
 
     OperationQueue(const OperationQueue &) = delete;
@@ -31,16 +55,37 @@ class OperationQueue
     void unregister(void *token);
     void shutdown();
     void wait();
+    OperationQueueStats getStats() const;
 
   private:
-    void workerRoutine();
+    using Clock = std::chrono::steady_clock;
+
+    struct TaskPackage {
+        TaskRoutine routine;
+        void *token;
+        Clock::time_point scheduledAt;
+    };
+
+    struct TokenState {
+        std::deque<TaskPackage> pending;
+        bool queued = false;
+        std::thread::id runningOn;
+    };
 
-    std::queue<TaskPackage> queue;
-    std::set<void *> tokens;
-    std::recursive_mutex mutex;
-    std::condition_variable_any condvar;
-    std::atomic<bool> cancellationFlag{false};
-    std::thread workerThread;
+    void workerRoutine();
+    void push(TaskPackage &&package);
+    bool isWorker() const;
+
+    std::deque<TaskPackage> queue;
+    std::vector<std::thread> workers;
+    std::map<void *, TokenState> tokens;
+    size_t runningCount = 0;
+    bool stopping       = false;
+    OperationQueueStats stats;
+
+    mutable std::mutex mutex;
+    std::condition_variable hasWork;
+    std::condition_variable finished;
 };
 
 struct BaseTask {
@@ -160,9 +205,20 @@ const size_t Hash<T, Args...>::hash_value = typeid(T(Args...)).hash_code();
 template <class T>
 using light_decay_t = std::remove_reference_t<std::remove_cv_t<T>>;
 
+// UI tasks such as login, logout and sync touch the same session state, so
+// they run on a single worker, one at a time, as they always have.
 class TaskBuilder
 {
   public:
+    static const size_t workersCount = 1;
+
+    TaskBuilder() : operationQueue(workersCount) {}
+
+    OperationQueueStats getQueueStats() const
+    {
+        return operationQueue.getStats();
+    }
+
     template <class Ret, class... Args>
     Task<light_decay_t<Ret>(light_decay_t<Args>...)> &task()
     {
@@ -0,0 +1,158 @@
+#include "pcm-gain.hpp"
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PCM_GAIN_X86 1
+#endif
+
+namespace gmusic
+{
+
+// All kernels compute (sample * gain + 2^14) >> 15 for gain < unity, so
+// they give the same result for any split of the buffer.
+static void scaleScalar(int16_t *samples, size_t count, int32_t gain)
+{
+    for (size_t i = 0; i < count; ++i) {
+        samples[i] = static_cast<int16_t>(
+            (samples[i] * gain + (1 << 14)) >> 15);
+    }
+}
+
+#ifdef PCM_GAIN_X86
+__attribute__((target("sse2"))) static void
+scaleSse2(int16_t *samples, size_t count, int32_t gain)
+{
+    const __m128i factor = _mm_set1_epi16(static_cast<int16_t>(gain));
+    const __m128i round  = _mm_set1_epi32(1 << 14);
+    size_t i             = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i *p = reinterpret_cast<__m128i *>(samples + i);
+        __m128i s  = _mm_loadu_si128(p);
+        __m128i lo = _mm_mullo_epi16(s, factor);
+        __m128i hi = _mm_mulhi_epi16(s, factor);
+        __m128i a  = _mm_add_epi32(_mm_unpacklo_epi16(lo, hi), round);
+        __m128i b  = _mm_add_epi32(_mm_unpackhi_epi16(lo, hi), round);
+        _mm_storeu_si128(
+            p, _mm_packs_epi32(_mm_srai_epi32(a, 15), _mm_srai_epi32(b, 15)));
+    }
+    scaleScalar(samples + i, count - i, gain);
+}
+
+// The unpacks and the pack work within each 128-bit lane, so the samples
+// come back in order.
+__attribute__((target("avx2"))) static void
+scaleAvx2(int16_t *samples, size_t count, int32_t gain)
+{
+    const __m256i factor = _mm256_set1_epi16(static_cast<int16_t>(gain));
+    const __m256i round  = _mm256_set1_epi32(1 << 14);
+    size_t i             = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i *p = reinterpret_cast<__m256i *>(samples + i);
+        __m256i s  = _mm256_loadu_si256(p);
+        __m256i lo = _mm256_mullo_epi16(s, factor);
+        __m256i hi = _mm256_mulhi_epi16(s, factor);
+        __m256i a  = _mm256_add_epi32(_mm256_unpacklo_epi16(lo, hi), round);
+        __m256i b  = _mm256_add_epi32(_mm256_unpackhi_epi16(lo, hi), round);
+        _mm256_storeu_si256(p,
+                            _mm256_packs_epi32(_mm256_srai_epi32(a, 15),
+                                               _mm256_srai_epi32(b, 15)));
+    }
+    scaleScalar(samples + i, count - i, gain);
+}
+#endif
+
+using ScaleFunction = void (*)(int16_t *, size_t, int32_t);
+
+static ScaleFunction selectScale()
+{
+#ifdef PCM_GAIN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return scaleAvx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return scaleSse2;
+    }
+#endif
+    return scaleScalar;
+}
+
+static void scale(int16_t *samples, size_t count, int32_t gain)
+{
+    static const ScaleFunction function = selectScale();
+    if (gain >= PcmGain::unity) {
+        return;
+    }
+    if (gain <= 0) {
+        std::fill(samples, samples + count, 0);
+        return;
+    }
+    function(samples, count, gain);
+}
+
+bool PcmGain::scaleWith(Kernel kernel,
+                        int16_t *samples,
+                        size_t count,
+                        int32_t gain)
+{
+    switch (kernel) {
+    case Kernel::Scalar:
+        scaleScalar(samples, count, gain);
+        return true;
+#ifdef PCM_GAIN_X86
+    case Kernel::Sse2:
+        __builtin_cpu_init();
+        if (!__builtin_cpu_supports("sse2")) {
+            return false;
+        }
+        scaleSse2(samples, count, gain);
+        return true;
+    case Kernel::Avx2:
+        __builtin_cpu_init();
+        if (!__builtin_cpu_supports("avx2")) {
+            return false;
+        }
+        scaleAvx2(samples, count, gain);
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+PcmGain::PcmGain(double volume)
+    : current{toFixed(volume)}, target{toFixed(volume)}
+{
+}
+
+int32_t PcmGain::toFixed(double volume)
+{
+    volume = std::min(std::max(volume, 0.0), 1.0);
+    return static_cast<int32_t>(volume * unity + 0.5);
+}
+
+void PcmGain::setVolume(double volume) { target = toFixed(volume); }
+
+void PcmGain::apply(int16_t *samples, size_t count, int channels)
+{
+    if (current == target) {
+        scale(samples, count, current);
+        return;
+    }
+
+    size_t frames = count / static_cast<size_t>(channels);
+    size_t blocks = (frames + rampBlockFrames - 1) / rampBlockFrames;
+    size_t block  = rampBlockFrames * static_cast<size_t>(channels);
+    int64_t step  = target - current;
+    for (size_t i = 0; i < blocks; ++i) {
+        auto progress = static_cast<int64_t>(i + 1);
+        auto gain     = static_cast<int32_t>(
+            current + step * progress / static_cast<int64_t>(blocks));
+        size_t offset = i * block;
+        scale(samples + offset, std::min(block, count - offset), gain);
+    }
+    current = target;
+}
+}
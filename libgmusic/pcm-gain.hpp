@@ -0,0 +1,45 @@
+#ifndef PCM_GAIN_HPP
+#define PCM_GAIN_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace gmusic
+{
+
+// Software volume for signed 16-bit interleaved PCM.
+//
+// The gain is a Q15 fixed-point factor, applied with SSE2 or AVX2 where the
+// CPU has them and with plain C++ otherwise. A volume change is not applied
+// as a step, which clicks, but ramped in over the next buffer in blocks of
+// rampBlockFrames with a constant gain each.
+class PcmGain
+{
+  public:
+    static const int32_t unity           = 1 << 15;
+    static const size_t rampBlockFrames = 32;
+
+    enum class Kernel { Scalar, Sse2, Avx2 };
+
+    explicit PcmGain(double volume = 1);
+
+    void setVolume(double volume);
+    void apply(int16_t *samples, size_t count, int channels);
+
+    // Scales by a Q15 gain in (0, unity) with the given kernel rather than
+    // the one apply() picks, for tests and benchmarks. Returns false if the
+    // CPU or the build has no such kernel.
+    static bool scaleWith(Kernel kernel,
+                          int16_t *samples,
+                          size_t count,
+                          int32_t gain);
+
+  private:
+    static int32_t toFixed(double volume);
+
+    int32_t current;
+    int32_t target;
+};
+}
+
+#endif // PCM_GAIN_HPP
@@ -1,9 +1,12 @@
 #include "player.hpp"
 
 #include <cassert>
+#include <chrono>
 #include <cmath>
 #include <cstring>
+#include <fcntl.h>
 #include <mpg123.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -14,33 +17,65 @@
     if (err_code != MPG123_OK)                                                 \
     throw exception(mpg123_plain_strerror(errCode))
 
-#define VOLUME_MAX_LEVEL 1
-
 namespace gmusic
 {
 
 AudioOutput::~AudioOutput() { Stop(); }
 
+// Picks a libao driver by its short name for the next device opened, in
+// place of the default one.
+bool AudioOutput::SetDriver(const std::string &name)
+{
+    int id = ao_driver_id(name.c_str());
+    if (id < 0) {
+        return false;
+    }
+    driver = id;
+    return true;
+}
+
+// Reopens the device only when the format changes, after what is queued in
+// the old format has been played.
 bool AudioOutput::Start(int bits, int channels, size_t rate)
 {
     if (device != nullptr) {
-        return true;
+        if (format.bits == bits && format.channels == channels &&
+            format.rate == static_cast<int>(rate)) {
+            return true;
+        }
+        Drain();
+        Stop();
     }
-    if (defaultDriver == -1) {
-        defaultDriver = ao_default_driver_id();
+    if (driver == -1) {
+        driver = ao_default_driver_id();
     }
     memset(&format, 0, sizeof(ao_sample_format));
     format.bits        = bits;
     format.byte_format = AO_FMT_NATIVE;
     format.channels    = channels;
     format.rate        = static_cast<int>(rate);
-    device             = ao_open_live(defaultDriver, &format, nullptr);
+    device             = ao_open_live(driver, &format, nullptr);
     if (device == nullptr) {
         char errBuf[1024];
         char *err = strerror_r(errno, errBuf, 1024);
         ERRLOG << err << std::endl;
         return false;
     }
+    ++deviceOpens;
+
+    frameBytes        = static_cast<size_t>(bits / 8 * channels);
+    size_t bytesPerMs = rate * frameBytes / 1000;
+    size_t capacity   = 1;
+    while (capacity < depthMs * bytesPerMs) {
+        capacity <<= 1;
+    }
+    ring.reset(new SpscRing(capacity));
+    period.resize(std::max(frameBytes,
+                           periodMs * bytesPerMs / frameBytes * frameBytes));
+    this->capacity = capacity;
+    minFill        = capacity;
+    running = true;
+    thread  = std::thread([this] { this->OutputRoutine(); });
     return true;
 }
 
@@ -49,71 +84,209 @@ bool AudioOutput::Stop()
     if (device == nullptr) {
         return true;
     }
-    if (ao_close(device) == 0) {
-        return false;
+    running = false;
+    if (thread.joinable()) {
+        thread.join();
     }
-    device = nullptr;
-    return true;
+    // Whatever is left in the buffer is not played.
+    playedBytes = queuedBytes.load();
+    CheckBoundary();
+    // The device is gone either way; keeping it would leave Play() and
+    // Flush() waiting on a thread that no longer runs.
+    bool closed = ao_close(device) != 0;
+    device      = nullptr;
+    return closed;
 }
 
-bool AudioOutput::Play(char *data, size_t len)
+// Waits for room in the buffer. Returns false without queueing the rest
+// if Interrupt() is called meanwhile.
+bool AudioOutput::Play(const char *data, size_t len)
 {
     if (device == nullptr) {
         return false;
     }
-    if (ao_play(device, data, static_cast<uint_32>(len)) == 0) {
+    while (true) {
+        size_t written = ring->write(data, len);
+        queuedBytes += written;
+        data += written;
+        len -= written;
+        if (len == 0) {
+            return true;
+        }
+        if (interrupted) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(periodMs / 2));
+    }
+}
+
+// Waits until everything queued has been played.
+void AudioOutput::Drain()
+{
+    if (device == nullptr) {
+        return;
+    }
+    draining = true;
+    while (ring->readable() >= frameBytes && !interrupted) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(periodMs));
+    }
+    draining = false;
+}
+
+// Drops everything queued, e.g. on a seek, and clears Interrupt().
+void AudioOutput::Flush()
+{
+    if (device != nullptr && running) {
+        flushRequested = true;
+        while (flushRequested && running) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    interrupted = false;
+}
+
+size_t AudioOutput::BufferedMs() const
+{
+    size_t bytesPerMs = static_cast<size_t>(format.rate) * frameBytes / 1000;
+    return ring && bytesPerMs > 0 ? ring->readable() / bytesPerMs : 0;
+}
+
+void AudioOutput::CheckBoundary()
+{
+    uint64_t at = boundary;
+    if (at != noBoundary && playedBytes >= at &&
+        boundary.compare_exchange_strong(at, noBoundary)) {
+        boundaryFill    = ring->readable();
+        boundaryReached = true;
+    }
+}
+
+// Returns true once for each boundary that has been reached, with the
+// audio that was buffered behind it at that moment.
+bool AudioOutput::TakeBoundary(size_t &bufferedMs)
+{
+    if (!boundaryReached || !boundaryReached.exchange(false)) {
         return false;
     }
+    size_t bytesPerMs = static_cast<size_t>(format.rate) * frameBytes / 1000;
+    bufferedMs        = bytesPerMs > 0 ? boundaryFill / bytesPerMs : 0;
     return true;
 }
 
+AudioOutputStats AudioOutput::GetStats() const
+{
+    AudioOutputStats stats;
+    stats.underruns   = underruns;
+    stats.periods     = periods;
+    stats.playedBytes = playedBytes;
+    stats.deviceOpens = deviceOpens;
+    stats.fillBytes   = fillBytes;
+    stats.minFill     = minFill;
+    stats.capacity    = capacity;
+    return stats;
+}
+
+void AudioOutput::OutputRoutine()
+{
+    bool hadData = false;
+    while (running) {
+        if (flushRequested) {
+            ring->consume(ring->readable());
+            playedBytes = queuedBytes.load();
+            CheckBoundary();
+            hadData        = false;
+            flushRequested = false;
+            continue;
+        }
+        if (paused) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(periodMs));
+            continue;
+        }
+        size_t fill = ring->readable();
+        size_t len  = std::min(fill, period.size()) / frameBytes * frameBytes;
+        fillBytes   = fill;
+        if (len == 0) {
+            if (hadData && !draining) {
+                ++underruns;
+            }
+            hadData = false;
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            continue;
+        }
+        if (hadData && fill < minFill) {
+            minFill = fill;
+        }
+        hadData = true;
+        ring->read(period.data(), len);
+        gain.setVolume(volume);
+        if (format.bits == 16) {
+            gain.apply(reinterpret_cast<int16_t *>(period.data()),
+                       len / sizeof(int16_t),
+                       format.channels);
+        }
+        ao_play(device, period.data(), static_cast<uint_32>(len));
+        playedBytes += len;
+        CheckBoundary();
+        ++periods;
+    }
+}
+
 AudioPlayer::AudioPlayer()
 {
     int errCode = mpg123_init();
     MPG123_CHECK_AND_THROW(errCode, AudioPlayerException);
     AudioOutput::Initialize();
+    output.SetVolume(currentVolumeScale);
 }
 
 AudioPlayer::~AudioPlayer()
 {
+    {
+        std::lock_guard<std::mutex> lock(trackMutex);
+        pendingTrackId.clear();
+    }
     requestedCommand = PLAYER_COMMAND_STOP;
+    output.Interrupt();
     downloadQueue.unregister(this);
     playQueue.unregister(this);
     output.Stop();
     mpg123_exit();
     AudioOutput::Destruct();
-    if (this->cachefile != nullptr) {
-        fclose(this->cachefile);
-        cachefile = nullptr;
-    }
+    closeTrackFile();
 }
 
 void AudioPlayer::stop()
 {
+    cancelQueued();
+    {
+        std::lock_guard<std::mutex> lock(trackMutex);
+        trackId.clear();
+        pendingTrackId.clear();
+    }
     stopRoutines();
+    closeTrackFile();
     resetDownloaderData();
     resetPlayerData();
-    if (this->cachefile) {
-        fclose(this->cachefile);
-        cachefile = nullptr;
-    }
 }
 
 void AudioPlayer::stopRoutines()
 {
     requestedCommand.store(PLAYER_COMMAND_STOP);
-    condvar.notify_one();
+    output.Interrupt();
+    streamBuffer.wake();
     playQueue.wait();
     downloadQueue.wait();
+    output.Flush();
+    // Playing another track after a pause starts it unpaused.
+    output.SetPaused(false);
     requestedCommand.store(PLAYER_COMMAND_PROCEED);
 }
 
 void AudioPlayer::resetDownloaderData()
 {
-    downloadingFinished = false;
-    hasMoreData         = false;
-    totalSize           = 0;
-    downloadProgress    = 0;
+    totalSize               = 0;
+    downloadProgress        = 0;
+    requestedDownloadOffset = -1;
 }
 
 void AudioPlayer::resetPlayerData()
@@ -131,76 +304,476 @@ void AudioPlayer::seek(double seconds)
     requestedSeekSeconds = seconds;
     shouldReportProgress = false;
     progressQueue.clear();
+    output.Interrupt();
+    streamBuffer.wake();
 }
 
 #define READBUF_SIZE 4096
 
-void AudioPlayer::playTrack(const std::string &url)
+static int openTemporaryFile()
+{
+    FILE *file = tmpfile();
+    if (file == nullptr) {
+        return -1;
+    }
+    int fd = dup(fileno(file));
+    fclose(file);
+    return fd;
+}
+
+// An error page must not end up in the cache, and a server that ignores the
+// range sends the whole file again.
+static bool acceptResponse(HttpSession &session, int fd, long &resumeOffset)
+{
+    long status = session.getStatusCode();
+    // Resumed at the end: an earlier prefetch got all of a short track.
+    if (status == 416 && resumeOffset > 0) {
+        return false;
+    }
+    if (status >= 300) {
+        ERRLOG << "download: HTTP status " << status << std::endl;
+        return false;
+    }
+    if (status != 206 && resumeOffset > 0) {
+        if (ftruncate(fd, 0) != 0) {
+            return false;
+        }
+        resumeOffset = 0;
+    }
+    return true;
+}
+
+static bool writeAt(int fd, const char *data, size_t len, uint64_t offset)
+{
+    for (size_t written = 0; written < len;) {
+        ssize_t n = pwrite(fd,
+                           data + written,
+                           len - written,
+                           static_cast<off_t>(offset + written));
+        if (n <= 0) {
+            ERRLOG << "download: write failed" << std::endl;
+            return false;
+        }
+        written += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+void AudioPlayer::playTrack(const std::string &trackId, const std::string &url)
 {
     stop();
     playerStatus = PLAYER_STATUS_PLAYING;
-
-    this->cachefile = tmpfile();
-    if (this->cachefile == nullptr) {
+    try {
+        openTrack(trackId, url);
+    } catch (...) {
         playerStatus = PLAYER_STATUS_IDLE;
-        throw std::runtime_error("failed to create temp file");
+        throw;
+    }
+    {
+        std::lock_guard<std::mutex> lock(trackMutex);
+        this->trackId = trackId;
     }
-    downloadQueue.scheduleTask([this, url] { this->downloadRoutine(url); },
-                               this);
-
     playQueue.scheduleTask([this] { this->playRoutine(); }, this);
 }
 
-void AudioPlayer::downloadRoutine(const std::string &url)
+// A cached track plays straight from its file. Otherwise the track is
+// downloaded into the cache, resuming a partial file if there is one, and
+// played while it arrives. Without a cache a temporary file is used.
+void AudioPlayer::openTrack(const std::string &trackId, const std::string &url)
+{
+    auto cachedPath = cache ? cache->lookup(trackId) : std::string();
+    if (cachedPath.empty() && url.empty()) {
+        throw std::runtime_error("track is neither cached nor streamable");
+    }
+
+    closeTrackFile();
+    if (!cachedPath.empty()) {
+        this->cachefd = open(cachedPath.c_str(), O_RDONLY);
+    } else if (cache) {
+        this->cachefd =
+            open(cache->partialPath(trackId).c_str(), O_RDWR | O_CREAT, 0644);
+    } else {
+        this->cachefd = openTemporaryFile();
+    }
+    struct stat fileStat;
+    if (this->cachefd == -1 || fstat(this->cachefd, &fileStat) != 0) {
+        throw std::runtime_error("failed to open cache file");
+    }
+    auto storedSize = static_cast<uint64_t>(fileStat.st_size);
+    streamBuffer.reset(this->cachefd, storedSize, !cachedPath.empty());
+
+    resetDownloaderData();
+    if (!cachedPath.empty()) {
+        STDLOG << "Playing " << trackId << " from cache" << std::endl;
+        totalSize        = static_cast<size_t>(storedSize);
+        downloadProgress = 1;
+    } else {
+        downloadQueue.scheduleTask(
+            [this, trackId, url] { this->downloadRoutine(trackId, url); },
+            this);
+    }
+}
+
+// Replaces the queued track. Its prefetch runs on the download queue, so it
+// starts once the current download is over and does not compete with it.
+void AudioPlayer::queueNext(const std::string &trackId,
+                            const UrlResolver &resolveUrl)
+{
+    uint64_t generation;
+    {
+        std::lock_guard<std::mutex> lock(trackMutex);
+        if (queuedTrack && queuedTrack->trackId == trackId) {
+            return;
+        }
+        queuedTrack = QueuedTrack{trackId, std::string(), resolveUrl};
+        generation  = ++prefetchGeneration;
+    }
+    downloadQueue.scheduleTask(
+        [this, trackId, generation] {
+            this->prefetchRoutine(trackId, generation);
+        },
+        this);
+}
+
+void AudioPlayer::cancelQueued()
+{
+    std::lock_guard<std::mutex> lock(trackMutex);
+    queuedTrack = boost::none;
+    ++prefetchGeneration;
+}
+
+std::string AudioPlayer::getTrackId() const
+{
+    std::lock_guard<std::mutex> lock(trackMutex);
+    return trackId;
+}
+
+// Called by the play routine when the current track has ended.
+bool AudioPlayer::startQueuedTrack()
+{
+    QueuedTrack next;
+    {
+        std::lock_guard<std::mutex> lock(trackMutex);
+        if (!queuedTrack) {
+            return false;
+        }
+        next = std::move(*queuedTrack);
+        queuedTrack = boost::none;
+    }
+    ++prefetchGeneration;
+
+    try {
+        bool cached = cache && cache->contains(next.trackId);
+        if (!cached && next.url.empty() && next.resolveUrl) {
+            next.url = next.resolveUrl();
+        }
+        openTrack(next.trackId, next.url);
+    } catch (const std::exception &exc) {
+        ERRLOG << "failed to start queued track " << next.trackId << ": "
+               << exc.what() << std::endl;
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(trackMutex);
+        pendingTrackId = next.trackId;
+    }
+    // The rest of the previous track is still in the output buffer.
+    output.MarkBoundary();
+    return true;
+}
+
+// Called by the play routine to pick up a boundary the output thread has
+// reached, which means the queued track has started to be heard. The
+// milliseconds that were still buffered then are the margin the switch had:
+// with none, there was a gap between the tracks.
+void AudioPlayer::queuedTrackReached()
+{
+    size_t bufferedMs;
+    if (!output.TakeBoundary(bufferedMs)) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(trackMutex);
+        if (pendingTrackId.empty()) {
+            return;
+        }
+        trackId.swap(pendingTrackId);
+        pendingTrackId.clear();
+    }
+    STDLOG << "Queued track reached the output with " << bufferedMs
+           << " ms of it buffered" << std::endl;
+    if (delegate != nullptr) {
+        delegate->playbackStarted();
+    }
+}
+
+// Downloads the track, starting where the file ends or wherever a seek
+// asks for, and then fills the gaps that seeking ahead left behind.
+void AudioPlayer::downloadRoutine(const std::string &trackId,
+                                  const std::string &url)
+{
+    // A prefetch may have added to the file after it was opened.
+    struct stat fileStat;
+    if (fstat(this->cachefd, &fileStat) == 0) {
+        streamBuffer.markStored(0, static_cast<uint64_t>(fileStat.st_size));
+    }
+
+    uint64_t offset = streamBuffer.missingFrom(0);
+    while (requestedCommand != PLAYER_COMMAND_STOP) {
+        uint64_t total = totalSize;
+        if (total > 0 && offset >= total) {
+            offset = streamBuffer.missingFrom(0);
+            if (offset >= total) {
+                break;
+            }
+        }
+        uint64_t start = offset;
+        bool ok        = downloadRange(url, offset);
+        auto seekTo    = requestedDownloadOffset.exchange(-1);
+        if (seekTo >= 0) {
+            offset = streamBuffer.missingFrom(static_cast<uint64_t>(seekTo));
+        } else if (!ok || offset == start) {
+            break;
+        } else {
+            offset = streamBuffer.missingFrom(offset);
+        }
+    }
+
+    uint64_t total = totalSize;
+    if (cache && total > 0 && streamBuffer.missingFrom(0) >= total &&
+        requestedCommand != PLAYER_COMMAND_STOP) {
+        cache->publish(trackId);
+    }
+    STDLOG << "Download of " << trackId << " finished with "
+           << streamBuffer.storedBytes() << " of " << total << " bytes"
+           << std::endl;
+    streamBuffer.finish();
+}
+
+// Downloads from offset up to the next range already in the file or the end
+// of the track, and advances offset past what was received. Returns false
+// if the transfer failed; stopping it for a seek is not a failure.
+bool AudioPlayer::downloadRange(const std::string &url, uint64_t &offset)
 {
-    HttpRequest requst(HttpMethod::GET, url);
+    HttpRequest request(HttpMethod::GET, url);
     HttpSession session;
 
-    STDLOG << "Starting download at url " << url << std::endl;
+    uint64_t total = totalSize;
+    uint64_t end   = std::min<uint64_t>(streamBuffer.nextStored(offset),
+                                      total > 0 ? total : UINT64_MAX);
+    // A server answers a resume from the end of the track with a 416.
+    bool resuming =
+        total == 0 && offset > 0 && offset == streamBuffer.missingFrom(0);
+    if (total > 0 && end < total) {
+        session.setByteRange(static_cast<long>(offset),
+                             static_cast<long>(end - 1));
+    } else if (offset > 0) {
+        session.setByteRange(static_cast<long>(offset));
+    }
+    STDLOG << "Downloading from byte " << offset << " of " << url
+           << std::endl;
 
-    session.setProgressCallback(
-        [this](size_t total, size_t received, HttpSession *) -> int {
-            this->downloadProgress =
-                total == 0 ? 0 : static_cast<double>(received) / total;
-            this->totalSize = total;
-            if (delegate) {
-                delegate->updateCacheProgress();
+    bool statusChecked = false;
+    bool stopped       = false;
+    session.setDataCallback([&, this](char *data, size_t len) -> size_t {
+        if (requestedCommand == PLAYER_COMMAND_STOP ||
+            requestedDownloadOffset >= 0) {
+            stopped = true;
+            return 0;
+        }
+        // An error page must not end up in the cache.
+        if (!statusChecked) {
+            statusChecked = true;
+            long status   = session.getStatusCode();
+            if (status == 416 && resuming) {
+                return 0;
             }
+            if (status >= 300) {
+                ERRLOG << "download: HTTP status " << status << std::endl;
+                return 0;
+            }
+            long long length = session.getContentLength();
+            if (status != 206) {
+                // The range was ignored and the whole file comes again.
+                offset = 0;
+                end    = UINT64_MAX;
+                if (length >= 0) {
+                    totalSize = static_cast<size_t>(length);
+                }
+            } else if (length >= 0 && total == 0) {
+                totalSize = static_cast<size_t>(offset + length);
+            }
+        }
+        // The buffer takes the bytes only once they are in the file, which
+        // the reader falls back to.
+        if (!writeAt(this->cachefd, data, len, offset)) {
             return 0;
         }
-    );
-
-    session.setDataCallback([this](char *data, size_t len) -> size_t {
-        if (requestedCommand == PLAYER_COMMAND_STOP) {
-            return len == 0 ? ++len : 0;
+        streamBuffer.append(offset, data, len);
+        offset += len;
+        if (totalSize > 0) {
+            downloadProgress =
+                static_cast<double>(streamBuffer.storedBytes()) / totalSize;
+        }
+        if (delegate) {
+            delegate->updateCacheProgress();
         }
-        std::unique_lock<std::mutex> lock(this->cachefileMutex);
-        fseek(this->cachefile, 0, SEEK_END);
-        size_t written = fwrite(data, sizeof(char), len, this->cachefile);
-        if (written != len) {
-            ERRLOG << "downloadRoutine: fwrite failed" << std::endl;
+        // Ran into data an earlier transfer got.
+        if (offset >= end) {
+            stopped = true;
+            return 0;
         }
-        lock.unlock();
-        hasMoreData = true;
-        condvar.notify_one();
         return len;
     });
 
-    auto result = session.makeRequest(requst);
-    STDLOG << "downloading: done with result " << result.error.message
-           << std::endl;
-    downloadingFinished = true;
-    condvar.notify_one();
+    auto result = session.makeRequest(request);
+    if (stopped) {
+        return true;
+    }
+    if (resuming && session.getStatusCode() == 416) {
+        totalSize = static_cast<size_t>(offset);
+        return true;
+    }
+    if (result.error.code != HttpErrorCode::OK) {
+        ERRLOG << "download: " << result.error.message << std::endl;
+        return false;
+    }
+    if (totalSize == 0) {
+        totalSize = static_cast<size_t>(offset);
+    }
+    return true;
+}
+
+// The cache resumes a partial file from its end, so whatever follows the
+// first gap of an unfinished download is cut off.
+void AudioPlayer::closeTrackFile()
+{
+    if (this->cachefd == -1) {
+        return;
+    }
+    uint64_t total    = totalSize;
+    uint64_t complete = streamBuffer.missingFrom(0);
+    if (total == 0 || complete < total) {
+        if (ftruncate(this->cachefd, static_cast<off_t>(complete)) != 0) {
+            ERRLOG << "failed to truncate partial download" << std::endl;
+        }
+    }
+    close(this->cachefd);
+    this->cachefd = -1;
+}
+
+// Resolves the stream url of the queued track and downloads its first
+// prefetchBytes into the cache, where the download that starts with the
+// track resumes them. Gives up as soon as the queue changes.
+void AudioPlayer::prefetchRoutine(const std::string &trackId,
+                                  uint64_t generation)
+{
+    auto cancelled = [this, generation] {
+        return generation != prefetchGeneration ||
+               requestedCommand == PLAYER_COMMAND_STOP;
+    };
+    if (cache && cache->contains(trackId)) {
+        return;
+    }
+
+    UrlResolver resolveUrl;
+    {
+        std::lock_guard<std::mutex> lock(trackMutex);
+        if (cancelled() || !queuedTrack || !queuedTrack->resolveUrl) {
+            return;
+        }
+        resolveUrl = queuedTrack->resolveUrl;
+    }
+    std::string url;
+    try {
+        url = resolveUrl();
+    } catch (const std::exception &exc) {
+        ERRLOG << "prefetch of " << trackId << " failed: " << exc.what()
+               << std::endl;
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(trackMutex);
+        if (cancelled()) {
+            return;
+        }
+        queuedTrack->url = url;
+    }
+    if (!cache) {
+        return;
+    }
+
+    int fd = open(cache->partialPath(trackId).c_str(), O_RDWR | O_CREAT, 0644);
+    struct stat fileStat;
+    if (fd == -1 || fstat(fd, &fileStat) != 0 ||
+        static_cast<size_t>(fileStat.st_size) >= prefetchBytes) {
+        if (fd != -1) {
+            close(fd);
+        }
+        return;
+    }
+
+    HttpRequest request(HttpMethod::GET, url);
+    HttpSession session;
+    long offset = static_cast<long>(fileStat.st_size);
+    if (offset > 0) {
+        session.setByteRange(offset);
+    }
+    bool statusChecked = false;
+    bool stopped       = false;
+    size_t received    = 0;
+    session.setDataCallback([&](char *data, size_t len) -> size_t {
+        if (cancelled()) {
+            stopped = true;
+            return 0;
+        }
+        if (!statusChecked) {
+            statusChecked = true;
+            if (!acceptResponse(session, fd, offset)) {
+                return 0;
+            }
+        }
+        if (!writeAt(fd, data, len, static_cast<uint64_t>(offset) + received)) {
+            return 0;
+        }
+        received += len;
+        // Stopping the transfer is the only way to end it early.
+        return static_cast<size_t>(offset) + received >= prefetchBytes ? 0
+                                                                       : len;
+    });
+    session.makeRequest(request);
+    close(fd);
+    STDLOG << "Prefetched " << received << " bytes of " << trackId
+           << (stopped ? " before the queue changed" : "") << std::endl;
 }
 
 void AudioPlayer::playRoutine()
 {
     char readBuffer[READBUF_SIZE];
-    long currentOffset = 0;
+    uint64_t currentOffset = 0;
 
     mpg123_handle *decoder = mpg123_new(nullptr, nullptr);
+    // Drops encoder delay and padding, so that queued tracks join up
+    // sample for sample.
+    mpg123_param(decoder, MPG123_ADD_FLAGS, MPG123_GAPLESS, 0);
+    // Always 16-bit output, which is what the volume stage works on.
+    const long *rates;
+    size_t rateCount;
+    mpg123_rates(&rates, &rateCount);
+    mpg123_format_none(decoder);
+    for (size_t i = 0; i < rateCount; ++i) {
+        mpg123_format(decoder,
+                      rates[i],
+                      MPG123_MONO | MPG123_STEREO,
+                      MPG123_ENC_SIGNED_16);
+    }
     mpg123_open_feed(decoder);
 
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point switchedAt;
+    Clock::time_point progressReportedAt;
+    bool measureGap = false;
+
     struct FormatInfo {
         int channels, encoding;
         long rate;
@@ -208,112 +781,157 @@ void AudioPlayer::playRoutine()
     } formatInfo;
 
     while (true) {
-        size_t read = 0;
-        do {
-            {
-                std::lock_guard<std::mutex> lock(seekMutex);
-                if (requestedCommand == PLAYER_COMMAND_SEEK) {
-                    if (this->totalSize > 0) {
-                        if (formatInfo.isSet) {
-                            off_t sampleOffset = static_cast<off_t>(
-                                formatInfo.rate * requestedSeekSeconds);
-                            off_t inputOffset;
-                            off_t success = mpg123_feedseek(
-                                decoder, sampleOffset, SEEK_SET, &inputOffset);
-                            if (success >= 0 &&
-                                inputOffset <=
-                                    this->totalSize * this->downloadProgress) {
-                                STDLOG << "Input offset: " << inputOffset
-                                       << std::endl;
-                                currentOffset = inputOffset;
+        queuedTrackReached();
+        {
+            std::lock_guard<std::mutex> lock(seekMutex);
+            if (requestedCommand == PLAYER_COMMAND_SEEK) {
+                output.Flush();
+                if (this->totalSize > 0) {
+                    if (formatInfo.isSet) {
+                        off_t sampleOffset = static_cast<off_t>(
+                            formatInfo.rate * requestedSeekSeconds);
+                        off_t inputOffset;
+                        off_t success = mpg123_feedseek(
+                            decoder, sampleOffset, SEEK_SET, &inputOffset);
+                        if (success >= 0 && static_cast<uint64_t>(
+                                                inputOffset) < totalSize) {
+                            STDLOG << "Input offset: " << inputOffset
+                                   << std::endl;
+                            currentOffset = static_cast<uint64_t>(inputOffset);
+                            streamBuffer.dropQueued();
+                            // Past what has arrived: move the download there.
+                            if (!streamBuffer.hasData(currentOffset) &&
+                                !streamBuffer.isComplete()) {
+                                requestedDownloadOffset =
+                                    static_cast<int64_t>(currentOffset);
                             }
                         }
                     }
-                    requestedCommand     = PLAYER_COMMAND_PROCEED;
-                    shouldReportProgress = true;
                 }
+                requestedCommand     = PLAYER_COMMAND_PROCEED;
+                shouldReportProgress = true;
             }
+        }
 
-            std::unique_lock<std::mutex> lock(this->cachefileMutex);
-            condvar.wait(lock, [this] {
-                if (requestedCommand == PLAYER_COMMAND_STOP) {
-                    return true;
-                }
-                if (hasMoreData || downloadingFinished) {
-                    if (playerStatus == PLAYER_STATUS_PAUSED &&
-                        requestedCommand != PLAYER_COMMAND_PROCEED) {
-                        return false;
-                    }
-                    return true;
-                }
-                return false;
-            });
+        int command = requestedCommand;
+        if (command == PLAYER_COMMAND_STOP) {
+            break;
+        } else if (command == PLAYER_COMMAND_PAUSE) {
+            playerStatus = PLAYER_STATUS_PAUSED;
+            streamBuffer.wait(
+                [this] { return requestedCommand != PLAYER_COMMAND_PAUSE; });
+            continue;
+        } else if (command == PLAYER_COMMAND_PROCEED) {
+            playerStatus = PLAYER_STATUS_PLAYING;
+        }
 
-            if (requestedCommand == PLAYER_COMMAND_STOP) {
-                goto exit;
-            } else if (requestedCommand == PLAYER_COMMAND_PAUSE) {
-                playerStatus = PLAYER_STATUS_PAUSED;
+        size_t read =
+            streamBuffer.read(currentOffset, readBuffer, READBUF_SIZE);
+        if (read == 0) {
+            // The download fills any gaps a seek left before it finishes,
+            // so the file is not swapped out from under it.
+            if (streamBuffer.isComplete() &&
+                !streamBuffer.hasData(currentOffset)) {
+                if (!startQueuedTrack()) {
+                    break;
+                }
+                // The audio device stays open unless the format changes.
+                mpg123_close(decoder);
+                mpg123_open_feed(decoder);
+                formatInfo.isSet = false;
+                currentOffset    = 0;
+                switchedAt       = Clock::now();
+                measureGap       = true;
                 continue;
-            } else if (requestedCommand == PLAYER_COMMAND_PROCEED) {
-                playerStatus = PLAYER_STATUS_PLAYING;
             }
+            streamBuffer.wait([this, currentOffset] {
+                return streamBuffer.hasData(currentOffset) ||
+                       streamBuffer.isComplete() ||
+                       requestedCommand != PLAYER_COMMAND_PROCEED;
+            });
+            continue;
+        }
+        currentOffset += read;
+        mpg123_feed(
+            decoder, reinterpret_cast<unsigned char *>(readBuffer), read);
 
-            fseek(this->cachefile, currentOffset, SEEK_SET);
-            read =
-                fread(readBuffer, sizeof(char), READBUF_SIZE, this->cachefile);
-            lock.unlock();
-            currentOffset += read;
-            mpg123_feed(
-                decoder, reinterpret_cast<unsigned char *>(readBuffer), read);
-
-            size_t done;
-            unsigned char *audioData;
-            off_t frameOffset;
-            do {
-
-                mpg123_volume(decoder, currentVolumeScale * VOLUME_MAX_LEVEL);
-                int err = mpg123_decode_frame(
-                    decoder, &frameOffset, &audioData, &done);
-                switch (err) {
-                case MPG123_NEW_FORMAT:
-                    int encoding;
-                    mpg123_getformat(decoder,
-                                     &formatInfo.rate,
-                                     &formatInfo.channels,
-                                     &encoding);
-                    formatInfo.encoding = mpg123_encsize(encoding);
-                    formatInfo.isSet    = true;
-                    output.Start(formatInfo.encoding * 8,
-                                 formatInfo.channels,
-                                 static_cast<size_t>(formatInfo.rate));
-                    playerStatus = PLAYER_STATUS_PLAYING;
-                    if (delegate != nullptr) {
-                        delegate->playbackStarted();
-                    }
-                    break;
-                case MPG123_OK:
-                    output.Play(reinterpret_cast<char *>(audioData), done);
-                    break;
+        size_t done;
+        unsigned char *audioData;
+        off_t frameOffset;
+        do {
+            int err =
+                mpg123_decode_frame(decoder, &frameOffset, &audioData, &done);
+            switch (err) {
+            case MPG123_NEW_FORMAT:
+                int encoding;
+                mpg123_getformat(decoder,
+                                 &formatInfo.rate,
+                                 &formatInfo.channels,
+                                 &encoding);
+                formatInfo.encoding = mpg123_encsize(encoding);
+                formatInfo.isSet    = true;
+                output.Start(formatInfo.encoding * 8,
+                             formatInfo.channels,
+                             static_cast<size_t>(formatInfo.rate));
+                playerStatus = PLAYER_STATUS_PLAYING;
+                // A queued track is reported once it is heard.
+                if (delegate != nullptr && !output.BoundaryPending()) {
+                    delegate->playbackStarted();
                 }
-            } while (done > 0);
-
-            if (shouldReportProgress && this->totalSize > 0 && delegate) {
-                double playbackProgress =
-                    static_cast<double>(currentOffset) / this->totalSize;
-                progressQueue.push(playbackProgress);
-                delegate->updatePlaybackProgress();
+                break;
+            case MPG123_OK:
+                if (measureGap) {
+                    measureGap = false;
+                    STDLOG << "Switched to the queued track in "
+                           << std::chrono::duration_cast<
+                                  std::chrono::microseconds>(
+                                  Clock::now() - switchedAt)
+                                  .count()
+                           << " us" << std::endl;
+                }
+                // Interrupted by a seek or stop; the rest of the input
+                // is dropped or replaced anyway.
+                if (!output.Play(reinterpret_cast<char *>(audioData), done)) {
+                    done = 0;
+                }
+                queuedTrackReached();
+                break;
             }
-
-        } while (read == READBUF_SIZE);
-
-        hasMoreData = false;
-        if (downloadingFinished) {
-            break;
+        } while (done > 0);
+
+        // Reported a few times a second rather than for every read.
+        auto now = Clock::now();
+        if (shouldReportProgress && this->totalSize > 0 && delegate &&
+            !output.BoundaryPending() &&
+            now - progressReportedAt >= std::chrono::milliseconds(100)) {
+            progressReportedAt = now;
+            double playbackProgress =
+                static_cast<double>(currentOffset) / this->totalSize;
+            progressQueue.push(playbackProgress);
+            delegate->updatePlaybackProgress();
         }
     }
 
-exit:
+    auto stats = streamBuffer.getStats();
+    STDLOG << "stream buffer: " << stats.ringBytes << " bytes from memory, "
+           << stats.diskBytes << " from disk, " << stats.spilled
+           << " spilled, " << stats.waits << " waits, " << stats.wakeups
+           << " wakeups" << std::endl;
+
+    if (requestedCommand == PLAYER_COMMAND_STOP) {
+        output.Flush();
+    } else {
+        output.Drain();
+    }
+    auto outputStats = output.GetStats();
+    STDLOG << "audio output: " << outputStats.underruns << " underruns in "
+           << outputStats.periods << " periods, lowest fill "
+           << outputStats.minFill << " of " << outputStats.capacity
+           << " bytes" << std::endl;
     output.Stop();
+    // A queued track that ended while the output drained is still started
+    // before it is finished.
+    queuedTrackReached();
     mpg123_delete(decoder);
     playerStatus = PLAYER_STATUS_IDLE;
     if (delegate != nullptr) {
@@ -327,6 +945,7 @@ void AudioPlayer::changeVolume(double volumeScale)
         return;
     }
     this->currentVolumeScale.store(volumeScale);
+    output.SetVolume(volumeScale);
 }
 
 double AudioPlayer::getLastProgressValue()
@@ -342,11 +961,16 @@ bool AudioPlayer::inProgress() const
     return playerStatus != PLAYER_STATUS_IDLE;
 }
 
-void AudioPlayer::pause() { requestedCommand = PLAYER_COMMAND_PAUSE; }
+void AudioPlayer::pause()
+{
+    requestedCommand = PLAYER_COMMAND_PAUSE;
+    output.SetPaused(true);
+}
 
 void AudioPlayer::resume()
 {
     requestedCommand = PLAYER_COMMAND_PROCEED;
-    condvar.notify_one();
+    output.SetPaused(false);
+    streamBuffer.wake();
 }
 }
@@ -2,13 +2,20 @@
 #define PLAYER_HPP
 
 #include <ao/ao.h>
+#include <boost/optional.hpp>
+#include <functional>
+#include <memory>
 #include <mpg123.h>
 #include <stdexcept>
 #include <string>
+#include <thread>
 
 #include "cache.hpp"
 #include "model/model.hpp"
 #include "operation-queue.hpp"
+#include "pcm-gain.hpp"
+#include "spsc-ring.hpp"
+#include "stream-buffer.hpp"
 #include "utilities.hpp"
 
 namespace gmusic
@@ -36,28 +43,107 @@ struct AudioPlayerDelegate {
     virtual ~AudioPlayerDelegate()        = default;
 };
 
+struct AudioOutputStats {
+    uint64_t underruns   = 0;
+    uint64_t periods     = 0;
+    // Includes what a flush or a stop dropped.
+    uint64_t playedBytes = 0;
+    uint64_t deviceOpens = 0;
+    size_t fillBytes     = 0;
+    size_t minFill       = 0;
+    size_t capacity      = 0;
+};
+
+// Plays PCM on a thread of its own. Play() queues decoded data in a jitter
+// buffer holding depthMs of audio and waits while it is full; the output
+// thread hands it to libao one period at a time, applying the volume right
+// before it so a change is heard without the buffer's delay. That thread
+// takes no locks and allocates nothing, and counts an underrun each time the
+// buffer runs dry in the middle of a stream.
+//
+// MarkBoundary() notes the end of what has been queued so far. Once that
+// has been played, or dropped by a flush, the output thread raises a flag,
+// along with how much was still buffered, for TakeBoundary() to collect on
+// another thread.
 struct AudioOutput {
+    static const size_t defaultDepthMs = 500;
+    static const size_t periodMs       = 20;
+
     static void Initialize() { ao_initialize(); }
     static void Destruct() { ao_shutdown(); }
 
     ~AudioOutput();
 
+    bool SetDriver(const std::string &name);
     bool Start(int bits, int channels, size_t rate);
     bool Stop();
-    bool Play(char *data, size_t len);
+    bool Play(const char *data, size_t len);
+    void Drain();
+    void Flush();
+    void SetPaused(bool paused) { this->paused = paused; }
+    void Interrupt() { interrupted = true; }
+    void SetDepth(size_t depthMs) { this->depthMs = depthMs; }
+    void SetVolume(double volume) { this->volume = volume; }
+    void MarkBoundary() { boundary = queuedBytes.load(); }
+    bool TakeBoundary(size_t &bufferedMs);
+    bool BoundaryPending() const
+    {
+        return boundary != noBoundary || boundaryReached;
+    }
+    size_t BufferedMs() const;
+    AudioOutputStats GetStats() const;
 
   private:
+    static const uint64_t noBoundary = UINT64_MAX;
+
+    void OutputRoutine();
+    void CheckBoundary();
+
     ao_device *device = nullptr;
     ao_sample_format format;
-    int defaultDriver = -1;
+    int driver        = -1;
+
+    std::atomic<size_t> depthMs{defaultDepthMs};
+    size_t frameBytes = 0;
+    std::unique_ptr<SpscRing> ring;
+    std::vector<char> period;
+    PcmGain gain;
+    std::atomic<double> volume{1};
+    std::atomic<uint64_t> queuedBytes{0};
+    std::atomic<uint64_t> playedBytes{0};
+    std::atomic<uint64_t> boundary{noBoundary};
+    std::atomic_bool boundaryReached{false};
+    std::atomic<size_t> boundaryFill{0};
+    std::thread thread;
+    std::atomic_bool running{false};
+    std::atomic_bool paused{false};
+    std::atomic_bool interrupted{false};
+    std::atomic_bool flushRequested{false};
+    std::atomic_bool draining{false};
+    std::atomic<uint64_t> underruns{0};
+    std::atomic<uint64_t> periods{0};
+    std::atomic<uint64_t> deviceOpens{0};
+    std::atomic<size_t> fillBytes{0};
+    std::atomic<size_t> minFill{0};
+    std::atomic<size_t> capacity{0};
 };
 
+// Plays one track at a time. A track queued with queueNext() starts as soon
+// as the current one ends, on the same decoder and audio device, and the
+// first prefetchBytes of it are downloaded into the cache beforehand.
 class AudioPlayer
 {
   public:
+    using UrlResolver = std::function<std::string()>;
+
+    static const size_t prefetchBytes = 512 * 1024;
+
     AudioPlayer();
     ~AudioPlayer();
-    void playTrack(const std::string &trackUrl);
+    void playTrack(const std::string &trackId, const std::string &trackUrl);
+    void queueNext(const std::string &trackId, const UrlResolver &resolveUrl);
+    void cancelQueued();
+    std::string getTrackId() const;
     void stop();
     void pause();
     void resume();
@@ -68,13 +154,32 @@ class AudioPlayer
     {
         this->delegate = delegate;
     }
+    void setCache(AudioCache *cache) { this->cache = cache; }
+    void setOutputDepth(size_t depthMs) { output.SetDepth(depthMs); }
+    bool setOutputDriver(const std::string &name)
+    {
+        return output.SetDriver(name);
+    }
+    AudioOutputStats getOutputStats() const { return output.GetStats(); }
     void seek(double seconds);
 
   private:
+    struct QueuedTrack {
+        std::string trackId;
+        std::string url;
+        UrlResolver resolveUrl;
+    };
+
+    void openTrack(const std::string &trackId, const std::string &url);
+    bool startQueuedTrack();
     void playRoutine();
     void playRoutine2();
-    void downloadRoutine(const std::string &url);
+    void downloadRoutine(const std::string &trackId, const std::string &url);
+    bool downloadRange(const std::string &url, uint64_t &offset);
+    void prefetchRoutine(const std::string &trackId, uint64_t generation);
     void stopRoutines();
+    void closeTrackFile();
+    void queuedTrackReached();
     void resetDownloaderData();
     void resetPlayerData();
 
@@ -89,16 +194,24 @@ class AudioPlayer
 
     OperationQueue downloadQueue;
     std::atomic<size_t> totalSize{0};
-    std::atomic_bool downloadingFinished{false};
-    std::atomic_bool hasMoreData{false};
     std::atomic<double> downloadProgress{0};
+    // Where the download should jump to for a seek, or -1.
+    std::atomic<int64_t> requestedDownloadOffset{-1};
 
-    std::condition_variable condvar;
-    std::mutex cachefileMutex;
+    StreamBuffer streamBuffer;
     AudioOutput output;
     AudioPlayerDelegate *delegate = nullptr;
+    AudioCache *cache             = nullptr;
+
+    int cachefd = -1;
 
-    FILE *cachefile = nullptr;
+    mutable std::mutex trackMutex;
+    // The track being heard, and the one the decoder has moved on to while
+    // the output still plays the end of the previous one.
+    std::string trackId;
+    std::string pendingTrackId;
+    boost::optional<QueuedTrack> queuedTrack;
+    std::atomic<uint64_t> prefetchGeneration{0};
 };
 }
 
@@ -1,10 +1,16 @@
 #include "session.hpp"
+#include "bounded-queue.hpp"
 #include "utilities.hpp"
 
 #include <algorithm>
 #include <array>
 #include <chrono>
+#include <cstdlib>
+#include <map>
 #include <mutex>
+#include <set>
+#include <thread>
+#include <unordered_map>
 #include <unordered_set>
 
 namespace gmapi
@@ -16,8 +22,25 @@ static const char *sessionTokenKey = "sessionToken";
 static const char *emailKey        = "email";
 static const char *deviceIdKey     = "deviceId";
 
-Session::Session(const std::string &basicPath) : storage(basicPath)
+// The feed is read with updated-min set to lastSyncTime. While a sync is
+// going through pages, the token of the next page and the updated-min it
+// belongs to are kept so an interrupted sync picks up where it stopped.
+static const char *lastSyncTimeKey    = "lastSyncTime";
+static const char *syncResumeTokenKey = "syncResumeToken";
+static const char *syncResumeSinceKey = "syncResumeSince";
+// Both move on after every page, even one that was not stored in full.
+// Tracks that failed are kept under syncFailedTracks as "id:attempts" and
+// fetched one by one at the start of the next sync, until they are stored
+// or have failed maxSyncAttempts times.
+static const char *syncFailedTracksKey = "syncFailedTracks";
+static const int maxSyncAttempts       = 3;
+
+Session::Session(const std::string &basicPath)
+    : responseCache(basicPath + "/http-cache"), storage(basicPath),
+      audioCache(basicPath + "/audio")
 {
+    api.setResponseCache(&responseCache);
+
     auto dbPath = basicPath + "/storage.sqlite";
 
     this->database = new Database(dbPath);
@@ -57,124 +80,356 @@ void Session::logout()
     storage.removeKey(sessionTokenKey);
     storage.removeKey(emailKey);
     storage.removeKey(deviceIdKey);
+    storage.removeKey(lastSyncTimeKey);
+    storage.removeKey(syncResumeTokenKey);
+    storage.removeKey(syncResumeSinceKey);
+    storage.removeKey(syncFailedTracksKey);
     database->clear();
     api.clearCredentials();
 }
 
-struct CheckedEntities {
-  private:
-    using ProtectedStorage =
-        std::pair<std::unordered_set<std::string>, std::mutex>;
-    ProtectedStorage artistsStorage;
-    ProtectedStorage albumsStorage;
-    bool checkStorage(ProtectedStorage &storage, const std::string &id);
-    void saveId(ProtectedStorage &storage, const std::string &id)
-    {
-        std::lock_guard<std::mutex> lock(storage.second);
-        storage.first.insert(id);
-    }
+// Ids that are in the database, mapped to whether this sync fetched them
+// rather than finding them stored. Shared by all pages of the feed, so each
+// artist and album is looked up and fetched at most once per sync.
+struct SyncContext {
+    std::unordered_map<std::string, bool> knownArtists;
+    std::unordered_map<std::string, bool> knownAlbums;
+    size_t artistsFetched      = 0;
+    size_t artistsDeduplicated = 0;
+    size_t albumsFetched       = 0;
+    size_t albumsDeduplicated  = 0;
+    uint64_t resolveArtistsUs  = 0;
+    uint64_t resolveAlbumsUs   = 0;
+    std::set<std::string> failedTracks;
+};
 
-  public:
-    bool checkAlbum(const std::string &id)
-    {
-        return checkStorage(albumsStorage, id);
-    }
+static uint64_t elapsedUs(std::chrono::steady_clock::time_point start)
+{
+    using namespace std::chrono;
+    return static_cast<uint64_t>(
+        duration_cast<microseconds>(steady_clock::now() - start).count());
+}
 
-    bool checkArtist(const std::string &id)
-    {
-        return checkStorage(artistsStorage, id);
+// Queues id for fetching unless it is known, already queued or stored.
+// Counts the requests saved because this page or an earlier one of the same
+// feed already fetches it.
+template <class Table>
+static void collectMissing(const std::string &id,
+                           const Table &table,
+                           std::unordered_map<std::string, bool> &known,
+                           std::unordered_set<std::string> &queued,
+                           size_t &deduplicated)
+{
+    auto knownIter = known.find(id);
+    if (knownIter != known.end()) {
+        if (knownIter->second) {
+            ++deduplicated;
+        }
+        return;
     }
+    if (queued.count(id) > 0) {
+        ++deduplicated;
+    } else if (table.contains(id)) {
+        known.emplace(id, false);
+    } else {
+        queued.insert(id);
+    }
+}
 
-    void saveAlbum(const std::string &id) { saveId(albumsStorage, id); }
+// Resolves the albums and artists of a whole page in two bursts, albums
+// first because they can name artists no track does. A track is written
+// only once everything it references is stored.
+void Session::syncTracks(const TrackList &tracks,
+                         db::WriteBatch &batch,
+                         SyncContext &context)
+{
+    std::unordered_set<std::string> albumIds;
+    for (const auto &track : tracks) {
+        collectMissing(track.albumId,
+                       database->getAlbumTable(),
+                       context.knownAlbums,
+                       albumIds,
+                       context.albumsDeduplicated);
+    }
+    auto start  = std::chrono::steady_clock::now();
+    auto albums = api.getAlbumApi().getAlbums(
+        std::vector<std::string>(albumIds.begin(), albumIds.end()),
+        maxInFlightRequests);
+    context.resolveAlbumsUs += elapsedUs(start);
+    context.albumsFetched += albums.size();
 
-    void saveArtist(const std::string &id) { saveId(artistsStorage, id); }
-};
+    std::unordered_set<std::string> artistIds;
+    auto collectArtists = [&](const std::vector<std::string> &ids) {
+        for (const auto &artistId : ids) {
+            collectMissing(artistId,
+                           database->getArtistTable(),
+                           context.knownArtists,
+                           artistIds,
+                           context.artistsDeduplicated);
+        }
+    };
+    for (const auto &track : tracks) {
+        collectArtists(track.artistIds);
+    }
+    for (const auto &entry : albums) {
+        collectArtists(entry.second.artistIds);
+    }
+    start        = std::chrono::steady_clock::now();
+    auto artists = api.getArtistApi().getArtists(
+        std::vector<std::string>(artistIds.begin(), artistIds.end()),
+        maxInFlightRequests);
+    context.resolveArtistsUs += elapsedUs(start);
+    context.artistsFetched += artists.size();
 
-bool CheckedEntities::checkStorage(ProtectedStorage &storage,
-                                   const std::string &id)
-{
-    std::lock_guard<std::mutex> lock(storage.second);
-    auto &checkedIds = storage.first;
-    return checkedIds.find(id) != checkedIds.end();
+    for (const auto &entry : artists) {
+        batch.add(entry.second);
+        context.knownArtists.emplace(entry.first, true);
+    }
+    auto hasArtists = [&context](const std::vector<std::string> &ids) {
+        return std::all_of(ids.begin(), ids.end(), [&](const std::string &id) {
+            return context.knownArtists.count(id) > 0;
+        });
+    };
+    for (const auto &entry : albums) {
+        if (hasArtists(entry.second.artistIds)) {
+            batch.add(entry.second);
+            context.knownAlbums.emplace(entry.first, true);
+        }
+    }
+    for (const auto &track : tracks) {
+        if (context.knownAlbums.count(track.albumId) > 0 &&
+            hasArtists(track.artistIds)) {
+            batch.add(track);
+        } else {
+            context.failedTracks.insert(track.trackId);
+            ERRLOG << "track " << track.trackId
+                   << ": album or artists unavailable" << std::endl;
+        }
+    }
 }
 
-void Session::handleTracks(TrackStorageIter begin,
-                           TrackStorageIter end,
-                           CheckedEntities &entities,
-                           std::unordered_set<Track> &cachedTracks,
-                           std::atomic_bool *cancelFlag)
+void Session::updateLocalDataPrivate(std::atomic_bool *cancelFlag)
 {
-    for (auto iter = begin; iter != end; ++iter) {
-        if (cancelFlag && *cancelFlag) {
-            return;
-        }
-        if (cachedTracks.find(*iter) != cachedTracks.end()) {
+    SyncStats stats;
+    auto syncStart = std::chrono::steady_clock::now();
+
+    auto since = storage.getValueForKey<uint64_t>(lastSyncTimeKey).value_or(0);
+    auto pageToken =
+        storage.getValueForKey<std::string>(syncResumeTokenKey).value_or("");
+    if (!pageToken.empty()) {
+        since =
+            storage.getValueForKey<uint64_t>(syncResumeSinceKey).value_or(0);
+    }
+    auto lastModified = since;
+
+    std::map<std::string, int> attempts;
+    auto retried =
+        storage.getValueForKey<std::string>(syncFailedTracksKey).value_or("");
+    for (const auto &entry : StringUtils::split(retried, ' ')) {
+        auto separator = entry.rfind(':');
+        if (separator == std::string::npos || separator == 0) {
             continue;
         }
+        attempts[entry.substr(0, separator)] =
+            std::atoi(entry.c_str() + separator + 1);
+    }
+
+    SyncContext context;
+    db::WriteBatch batch(database);
+
+    // Saved along with every checkpoint, since the feed will not bring the
+    // failed tracks back once the checkpoint is past them.
+    auto saveFailedTracks = [&] {
+        std::string entries;
+        for (const auto &trackId : context.failedTracks) {
+            auto iter  = attempts.find(trackId);
+            int failed = (iter != attempts.end() ? iter->second : 0) + 1;
+            if (failed >= maxSyncAttempts) {
+                continue;
+            }
+            entries += (entries.empty() ? "" : " ") + trackId + ':' +
+                       std::to_string(failed);
+        }
+        if (entries.empty()) {
+            storage.removeKey(syncFailedTracksKey);
+        } else {
+            storage.saveValueForKey(entries, syncFailedTracksKey);
+        }
+    };
+    auto storePage = [&](const TrackList &tracks) {
+        for (const auto &track : tracks) {
+            context.failedTracks.erase(track.trackId);
+        }
+        syncTracks(tracks, batch, context);
+        if (!batch.flush()) {
+            // Nothing of the page was stored, including what it added to
+            // the known ids.
+            for (const auto &track : tracks) {
+                context.failedTracks.insert(track.trackId);
+            }
+            context.knownArtists.clear();
+            context.knownAlbums.clear();
+        }
+    };
+
+    if (!attempts.empty()) {
+        STDLOG << "sync: retrying " << attempts.size()
+               << " tracks that failed before" << std::endl;
+        TrackList tracks;
+        for (const auto &entry : attempts) {
+            try {
+                tracks.push_back(api.getTrackApi().getTrack(entry.first));
+            } catch (const std::exception &e) {
+                ERRLOG << "track " << entry.first << ": " << e.what()
+                       << std::endl;
+                context.failedTracks.insert(entry.first);
+            }
+        }
+        stats.tracksRetried = attempts.size();
+        storePage(tracks);
+        saveFailedTracks();
+        storage.sync();
+    }
+
+    // The next page token is only known once a page is parsed, so the
+    // fetcher downloads and parses while this thread resolves and persists
+    // the pages it has already handed over.
+    BoundedQueue<TrackFeedPage> pages(feedPipelineDepth);
+    std::exception_ptr fetchError;
+    uint64_t fetchFeedUs = 0;
+    std::thread fetcher([&, pageToken] {
+        auto token = pageToken;
         try {
-            for (const auto &artistId : iter->artistIds) {
-                if (!entities.checkArtist(artistId)) {
-                    auto artist = api.getArtistApi().getArtist(artistId);
-                    database->getArtistTable().insert(artist);
-                    entities.saveArtist(artistId);
+            do {
+                auto feedStart = std::chrono::steady_clock::now();
+                auto page = api.getTrackApi().getTrackFeedPage(token, since);
+                fetchFeedUs += elapsedUs(feedStart);
+                token = page.nextPageToken;
+                if (!pages.push(std::move(page))) {
+                    break;
                 }
+            } while (!token.empty() && !(cancelFlag && *cancelFlag));
+        } catch (...) {
+            fetchError = std::current_exception();
+        }
+        pages.close();
+    });
+
+    bool complete = false;
+    try {
+        TrackFeedPage page;
+        while (pages.pop(page)) {
+            ++stats.pages;
+            stats.tracksChanged += page.tracks.size();
+            stats.tracksDeleted += page.deletedTrackIds.size();
+            lastModified = std::max(lastModified, page.lastModifiedUs);
+
+            for (const auto &trackId : page.deletedTrackIds) {
+                Track track;
+                track.trackId = trackId;
+                database->getTrackTable().remove(track);
+                context.failedTracks.erase(trackId);
+                attempts.erase(trackId);
             }
-            if (!entities.checkAlbum(iter->albumId)) {
-                auto album = api.getAlbumApi().getAlbum(iter->albumId);
-                for (const auto &artistId : album.artistIds) {
-                    if (!entities.checkArtist(artistId)) {
-                        auto artist = api.getArtistApi().getArtist(artistId);
-                        database->getArtistTable().insert(artist);
-                        entities.saveArtist(artistId);
-                    }
-                }
-                database->getAlbumTable().insert(album);
-                entities.saveAlbum(iter->albumId);
+            storePage(page.tracks);
+
+            if (cancelFlag && *cancelFlag) {
+                break;
+            }
+            if (page.nextPageToken.empty()) {
+                complete = true;
+            } else {
+                storage.saveValueForKey(page.nextPageToken,
+                                        syncResumeTokenKey);
+                storage.saveValueForKey(since, syncResumeSinceKey);
+                saveFailedTracks();
+                storage.sync();
             }
-            database->getTrackTable().insert(*iter);
-        } catch (const ApiRequestException &exc) {
-            ERRLOG << exc.what() << std::endl;
-        } catch (const std::exception &exc) {
-            ERRLOG << exc.what() << std::endl;
+            reportSyncProgress(stats);
         }
+    } catch (...) {
+        pages.close();
+        fetcher.join();
+        throw;
+    }
+    pages.close();
+    fetcher.join();
+    if (fetchError) {
+        std::rethrow_exception(fetchError);
+    }
+    stats.fetchFeedUs = fetchFeedUs;
+
+    if (complete) {
+        storage.saveValueForKey(lastModified, lastSyncTimeKey);
+        storage.removeKey(syncResumeTokenKey);
+        storage.removeKey(syncResumeSinceKey);
+    }
+    for (const auto &trackId : context.failedTracks) {
+        auto iter = attempts.find(trackId);
+        if (iter != attempts.end() && iter->second + 1 >= maxSyncAttempts) {
+            ERRLOG << "track " << trackId << ": giving up after "
+                   << maxSyncAttempts << " attempts" << std::endl;
+        }
+    }
+    saveFailedTracks();
+    storage.sync();
+
+    auto batchStats = batch.getStats();
+
+    stats.artistsFetched      = context.artistsFetched;
+    stats.artistsDeduplicated = context.artistsDeduplicated;
+    stats.albumsFetched       = context.albumsFetched;
+    stats.albumsDeduplicated  = context.albumsDeduplicated;
+    stats.failedTracks        = context.failedTracks.size();
+    stats.resolveArtistsUs    = context.resolveArtistsUs;
+    stats.resolveAlbumsUs     = context.resolveAlbumsUs;
+    stats.persistUs           = batchStats.flushTimeUs;
+    stats.totalUs             = elapsedUs(syncStart);
+
+    STDLOG << "sync: " << stats.pages << " pages, " << stats.tracksChanged
+           << " changed and " << stats.tracksDeleted << " deleted tracks, "
+           << stats.artistsFetched << " artists, " << stats.albumsFetched
+           << " albums, " << stats.failedTracks << " failed, "
+           << stats.tracksRetried << " retried" << std::endl;
+    STDLOG << "sync deduplicated requests: " << stats.artistsDeduplicated
+           << " artists, " << stats.albumsDeduplicated << " albums"
+           << std::endl;
+    STDLOG << "sync phases: feed " << stats.fetchFeedUs / 1000
+           << "ms, artists " << stats.resolveArtistsUs / 1000
+           << "ms, albums " << stats.resolveAlbumsUs / 1000 << "ms, persist "
+           << stats.persistUs / 1000 << "ms (" << batchStats.rowsWritten
+           << " rows in " << batchStats.flushes << " transactions)"
+           << std::endl;
+
+    std::lock_guard<std::mutex> lock(statsMutex);
+    lastSyncStats = stats;
+}
+
+void Session::reportSyncProgress(const SyncStats &stats)
+{
+    std::unique_lock<std::mutex> lock(statsMutex);
+    auto callback = syncProgressCallback;
+    lock.unlock();
+    if (callback) {
+        callback(stats);
     }
 }
 
-void Session::updateLocalDataPrivate(std::atomic_bool *cancelFlag)
+void Session::setSyncProgressCallback(const SyncProgressCallback &callback)
 {
-    auto allTracks = database->getTrackTable().getAll();
-
-    std::unordered_set<Track> cachedTracks;
-    std::move(allTracks.begin(),
-              allTracks.end(),
-              std::inserter(cachedTracks, cachedTracks.end()));
-
-    auto tracks = api.getTrackApi().getTrackList();
-    CheckedEntities entities;
-
-    int tasknum    = std::thread::hardware_concurrency();
-    long chunkSize = tracks.size() / tasknum;
-    std::vector<std::future<void>> tasks;
-    tasks.resize(tasknum);
-    for (int i = 0; i < tasknum - 1; ++i) {
-        tasks[i] = std::async(std::launch::async,
-                              &Session::handleTracks,
-                              this,
-                              tracks.begin() + chunkSize * i,
-                              tracks.begin() + chunkSize * (i + 1),
-                              std::ref(entities),
-                              std::ref(cachedTracks),
-                              cancelFlag);
-    }
-    tasks[tasknum - 1] = std::async(std::launch::async,
-                                    &Session::handleTracks,
-                                    this,
-                                    tracks.begin() + chunkSize * (tasknum - 1),
-                                    tracks.begin() + chunkSize * tasknum +
-                                        tracks.size() % tasknum,
-                                    std::ref(entities),
-                                    std::ref(cachedTracks),
-                                    cancelFlag);
+    std::lock_guard<std::mutex> lock(statsMutex);
+    syncProgressCallback = callback;
+}
+
+void Session::setMaxInFlightRequests(size_t count)
+{
+    maxInFlightRequests = count > 0 ? count : 1;
+}
+
+SyncStats Session::getLastSyncStats() const
+{
+    std::lock_guard<std::mutex> lock(statsMutex);
+    return lastSyncStats;
 }
 
 void Session::updateLocalData(std::atomic_bool *cancelFlag)
@@ -186,5 +441,39 @@ void Session::updateLocalData(std::atomic_bool *cancelFlag)
     high_resolution_clock::time_point t2 = high_resolution_clock::now();
     auto duration = duration_cast<milliseconds>(t2 - t1).count();
     STDLOG << "updateLocalData: " << duration << "ms" << std::endl;
+
+    auto poolStats = database->getPoolStats();
+    STDLOG << "db pool: " << poolStats.readersOpened << "/"
+           << poolStats.readersCapacity << " readers, "
+           << poolStats.connectionsOpened << " connections opened, "
+           << poolStats.acquisitions << " acquisitions, " << poolStats.waits
+           << " waits (" << poolStats.waitTimeUs / 1000 << "ms)" << std::endl;
+    STDLOG << "db statement cache: " << poolStats.statementCache.hits
+           << " hits, " << poolStats.statementCache.misses << " misses, "
+           << poolStats.statementCache.evictions << " evictions" << std::endl;
+
+    auto queueStats = taskBuilder.getQueueStats();
+    STDLOG << "task queue: " << queueStats.executed << " tasks, "
+           << queueStats.queueDepth << " queued (max "
+           << queueStats.maxQueueDepth << "), "
+           << queueStats.averageWaitUs() / 1000 << "ms average wait"
+           << std::endl;
+
+    auto shareStats = api.getShareStats();
+    STDLOG << "http: " << shareStats.requests << " requests, "
+           << shareStats.connectionsOpened << " connections opened, "
+           << shareStats.handshakesAvoided << " handshakes avoided"
+           << std::endl;
+    auto clientStats = api.getClientStats();
+    STDLOG << "http client: " << clientStats.requests << " requests, "
+           << clientStats.failures << " failed, "
+           << clientStats.connectionsOpened << " connections opened, "
+           << clientStats.maxInFlight << " max in flight" << std::endl;
+    auto cacheStats = responseCache.getStats();
+    STDLOG << "http cache: " << cacheStats.hits << " fresh and "
+           << cacheStats.revalidated << " revalidated of "
+           << cacheStats.lookups << " lookups ("
+           << static_cast<int>(cacheStats.hitRate() * 100) << "%), "
+           << cacheStats.bytesSaved / 1024 << "KB saved" << std::endl;
 }
 }
@@ -2,22 +2,46 @@
 #define SESSION_HPP
 
 #include "api/gmapi.hpp"
+#include "cache.hpp"
 #include "db/database.hpp"
+#include "db/write-batch.hpp"
 #include "kvstorage.hpp"
 #include "operation-queue.hpp"
+#include <atomic>
+#include <mutex>
 #include <string>
-#include <unordered_set>
 
 namespace gmusic
 {
 
-struct CheckedEntities;
+struct SyncContext;
+
+struct SyncStats {
+    size_t pages               = 0;
+    size_t tracksChanged       = 0;
+    size_t tracksDeleted       = 0;
+    size_t artistsFetched      = 0;
+    size_t artistsDeduplicated = 0;
+    size_t albumsFetched       = 0;
+    size_t albumsDeduplicated  = 0;
+    size_t failedTracks        = 0;
+    size_t tracksRetried       = 0;
+    uint64_t fetchFeedUs       = 0;
+    uint64_t resolveArtistsUs  = 0;
+    uint64_t resolveAlbumsUs   = 0;
+    uint64_t persistUs         = 0;
+    uint64_t totalUs           = 0;
+};
 
 class Session
 {
   public:
-    using UpdateCallback = std::function<void(std::shared_future<void>)>;
-    using OpenCallback   = std::function<void(std::shared_future<void>)>;
+    using UpdateCallback       = std::function<void(std::shared_future<void>)>;
+    using OpenCallback         = std::function<void(std::shared_future<void>)>;
+    using SyncProgressCallback = std::function<void(const SyncStats &)>;
+
+    static const size_t defaultMaxInFlightRequests = 32;
+    static const size_t feedPipelineDepth          = 2;
 
     Session(const std::string &basicPath);
     ~Session();
@@ -29,22 +53,28 @@ class Session
     db::Database *getDatabase() { return database; }
     bool isAuthorized() { return api.isLoggedIn(); }
     void updateLocalData(std::atomic_bool *cancelFlag);
+    void setMaxInFlightRequests(size_t count);
+    void setSyncProgressCallback(const SyncProgressCallback &callback);
+    SyncStats getLastSyncStats() const;
 
     KeyValueStorage &getStorage() { return storage; }
+    AudioCache &getAudioCache() { return audioCache; }
 
     TaskBuilder taskBuilder;
 
   private:
-    using TrackStorageIter = std::vector<Track>::iterator;
     void updateLocalDataPrivate(std::atomic_bool *cancelFlag);
-    void handleTracks(TrackStorageIter begin,
-                      TrackStorageIter end,
-                      CheckedEntities &,
-                      std::unordered_set<Track> &,
-                      std::atomic_bool *cancelFlag);
+    void reportSyncProgress(const SyncStats &stats);
+    void syncTracks(const TrackList &tracks, db::WriteBatch &, SyncContext &);
     db::Database *database = nullptr;
+    ResponseCache responseCache;
     GMApi api;
     KeyValueStorage storage;
+    AudioCache audioCache;
+    std::atomic<size_t> maxInFlightRequests{defaultMaxInFlightRequests};
+    SyncStats lastSyncStats;
+    SyncProgressCallback syncProgressCallback;
+    mutable std::mutex statsMutex;
 };
 }
 
@@ -0,0 +1,112 @@
+#ifndef SPSC_RING_HPP
+#define SPSC_RING_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace gmusic
+{
+
+// Lock-free byte ring for one producer thread and one consumer thread.
+// The capacity must be a power of two.
+//
+// The producer may put() data at an offset past what it has committed and
+// publish it all at once with commit(); the consumer may peek() before it
+// consume()s. write() and read() do both steps for as much as fits.
+class SpscRing
+{
+  public:
+    explicit SpscRing(size_t capacity) : buffer(capacity), mask{capacity - 1}
+    {
+        assert(capacity > 0 && (capacity & mask) == 0);
+    }
+
+    size_t capacity() const { return buffer.size(); }
+
+    // Producer side.
+    size_t writable() const
+    {
+        return buffer.size() - static_cast<size_t>(
+                                   head.load(std::memory_order_relaxed) -
+                                   tail.load(std::memory_order_acquire));
+    }
+    void put(size_t offset, const void *data, size_t len)
+    {
+        copyIn(head.load(std::memory_order_relaxed) + offset, data, len);
+    }
+    void commit(size_t len)
+    {
+        head.store(head.load(std::memory_order_relaxed) + len,
+                   std::memory_order_release);
+    }
+    size_t write(const void *data, size_t len)
+    {
+        len = std::min(len, writable());
+        put(0, data, len);
+        commit(len);
+        return len;
+    }
+
+    // Consumer side.
+    size_t readable() const
+    {
+        return static_cast<size_t>(head.load(std::memory_order_acquire) -
+                                   tail.load(std::memory_order_relaxed));
+    }
+    void peek(size_t offset, void *data, size_t len) const
+    {
+        copyOut(tail.load(std::memory_order_relaxed) + offset, data, len);
+    }
+    void consume(size_t len)
+    {
+        tail.store(tail.load(std::memory_order_relaxed) + len,
+                   std::memory_order_release);
+    }
+    size_t read(void *data, size_t len)
+    {
+        len = std::min(len, readable());
+        peek(0, data, len);
+        consume(len);
+        return len;
+    }
+
+    // Neither side may be running.
+    void clear()
+    {
+        head = 0;
+        tail = 0;
+    }
+
+  private:
+    void copyIn(uint64_t position, const void *data, size_t len)
+    {
+        size_t start = position & mask;
+        size_t first = std::min(len, buffer.size() - start);
+        memcpy(&buffer[start], data, first);
+        memcpy(
+            &buffer[0], static_cast<const char *>(data) + first, len - first);
+    }
+    void copyOut(uint64_t position, void *data, size_t len) const
+    {
+        size_t start = position & mask;
+        size_t first = std::min(len, buffer.size() - start);
+        memcpy(data, &buffer[start], first);
+        memcpy(static_cast<char *>(data) + first, &buffer[0], len - first);
+    }
+
+    std::vector<char> buffer;
+    size_t mask;
+    // Padding keeps the two indices off a shared cache line; alignas would
+    // need an aligned operator new, which C++14 lacks.
+    char headPadding[64];
+    std::atomic<uint64_t> head{0};
+    char tailPadding[64];
+    std::atomic<uint64_t> tail{0};
+};
+}
+
+#endif // SPSC_RING_HPP
@@ -0,0 +1,250 @@
+#include "stream-buffer.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+#include <limits>
+#include <unistd.h>
+
+namespace gmusic
+{
+
+// Merges with the ranges it overlaps or touches.
+void ByteRangeSet::add(uint64_t start, uint64_t end)
+{
+    if (start >= end) {
+        return;
+    }
+    auto it = ranges.upper_bound(start);
+    if (it != ranges.begin() && std::prev(it)->second >= start) {
+        --it;
+        start = it->first;
+    }
+    while (it != ranges.end() && it->first <= end) {
+        end = std::max(end, it->second);
+        bytes -= it->second - it->first;
+        it = ranges.erase(it);
+    }
+    ranges.emplace_hint(it, start, end);
+    bytes += end - start;
+}
+
+void ByteRangeSet::clear()
+{
+    ranges.clear();
+    bytes = 0;
+}
+
+ByteRangeSet::Ranges::const_iterator ByteRangeSet::find(uint64_t offset) const
+{
+    auto it = ranges.upper_bound(offset);
+    if (it == ranges.begin() || std::prev(it)->second <= offset) {
+        return ranges.end();
+    }
+    return std::prev(it);
+}
+
+bool ByteRangeSet::contains(uint64_t offset) const
+{
+    return find(offset) != ranges.end();
+}
+
+// The first offset from the given one that is not present.
+uint64_t ByteRangeSet::missingFrom(uint64_t offset) const
+{
+    auto it = find(offset);
+    return it == ranges.end() ? offset : it->second;
+}
+
+// Start of the first range beginning after offset, or the largest offset.
+uint64_t ByteRangeSet::nextStart(uint64_t offset) const
+{
+    auto it = ranges.upper_bound(offset);
+    return it == ranges.end() ? std::numeric_limits<uint64_t>::max()
+                              : it->first;
+}
+
+StreamBuffer::StreamBuffer(size_t capacity) : ring(capacity)
+{
+    assert(capacity > sizeof(Record));
+}
+
+void StreamBuffer::reset(int fd, uint64_t stored, bool complete)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    {
+        std::lock_guard<std::mutex> storedLock(storedMutex);
+        this->stored.clear();
+        this->stored.add(0, stored);
+        prefixEnd      = stored;
+        detachedBytes  = 0;
+        nextRangeStart = std::numeric_limits<uint64_t>::max();
+    }
+    this->fd         = fd;
+    this->complete   = complete;
+    ring.clear();
+    hasCurrent       = false;
+    consumed         = 0;
+    pendingWakeBytes = 0;
+}
+
+// A chunk that does not fit is only on disk; the reader picks it up there.
+void StreamBuffer::append(uint64_t offset, const char *data, size_t len)
+{
+    Record record;
+    record.offset = offset;
+    record.len    = len;
+
+    if (ring.writable() >= sizeof(Record) + len) {
+        ring.put(0, &record, sizeof(Record));
+        ring.put(sizeof(Record), data, len);
+        ring.commit(sizeof(Record) + len);
+    } else {
+        spilled += len;
+    }
+    markStored(offset, offset + len);
+
+    pendingWakeBytes += len;
+    if (pendingWakeBytes >= wakeupThreshold && consumerWaiting) {
+        pendingWakeBytes = 0;
+        wake();
+    }
+}
+
+// Also for data written to the file outside append(), e.g. by a prefetch.
+void StreamBuffer::markStored(uint64_t start, uint64_t end)
+{
+    uint64_t prefix = prefixEnd;
+    if (start <= prefix && end < nextRangeStart) {
+        if (end > prefix) {
+            prefixEnd = end;
+        }
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(storedMutex);
+    stored.add(0, prefix);
+    stored.add(start, end);
+    prefix = stored.missingFrom(0);
+    // Shrinks before the prefix grows, so storedBytes() never overcounts.
+    detachedBytes  = stored.size() - prefix;
+    prefixEnd      = prefix;
+    nextRangeStart = stored.nextStart(prefix);
+}
+
+bool StreamBuffer::hasData(uint64_t offset) const
+{
+    if (offset < prefixEnd) {
+        return true;
+    }
+    std::lock_guard<std::mutex> lock(storedMutex);
+    return stored.contains(offset);
+}
+
+uint64_t StreamBuffer::missingFrom(uint64_t offset) const
+{
+    uint64_t prefix = prefixEnd;
+    if (offset < prefix) {
+        return prefix;
+    }
+    std::lock_guard<std::mutex> lock(storedMutex);
+    return stored.missingFrom(offset);
+}
+
+uint64_t StreamBuffer::nextStored(uint64_t offset) const
+{
+    std::lock_guard<std::mutex> lock(storedMutex);
+    return stored.nextStart(offset);
+}
+
+// Reads the prefix first; markStored() updates it last.
+uint64_t StreamBuffer::storedBytes() const
+{
+    uint64_t prefix = prefixEnd;
+    return prefix + detachedBytes;
+}
+
+void StreamBuffer::finish()
+{
+    complete = true;
+    wake();
+}
+
+void StreamBuffer::wake()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    ++wakeups;
+    condvar.notify_one();
+}
+
+size_t StreamBuffer::read(uint64_t offset, char *buffer, size_t len)
+{
+    if (len == 0) {
+        return 0;
+    }
+    while (true) {
+        if (!hasCurrent) {
+            if (ring.readable() < sizeof(Record)) {
+                break;
+            }
+            ring.read(&current, sizeof(Record));
+            consumed   = 0;
+            hasCurrent = true;
+        }
+        uint64_t recordOffset = current.offset + consumed;
+        uint64_t left         = current.len - consumed;
+        if (recordOffset > offset) {
+            break;
+        }
+        // Skip what lies before offset, e.g. after a seek forward.
+        uint64_t skip = std::min(left, offset - recordOffset);
+        size_t n =
+            static_cast<size_t>(std::min<uint64_t>(len, left - skip));
+        ring.peek(skip, buffer, n);
+        ring.consume(skip + n);
+        consumed += skip + n;
+        if (consumed == current.len) {
+            hasCurrent = false;
+        }
+        if (n > 0) {
+            ringBytes += n;
+            return n;
+        }
+    }
+
+    // Nothing in the ring at offset: read the file up to the next record.
+    uint64_t limit = missingFrom(offset);
+    if (hasCurrent) {
+        limit = std::min(limit, current.offset + consumed);
+    }
+    if (offset >= limit) {
+        return 0;
+    }
+    size_t n = static_cast<size_t>(std::min<uint64_t>(len, limit - offset));
+    ssize_t done = pread(fd, buffer, n, static_cast<off_t>(offset));
+    if (done <= 0) {
+        return 0;
+    }
+    diskBytes += static_cast<uint64_t>(done);
+    return static_cast<size_t>(done);
+}
+
+// Forgets what the ring holds, which after a seek is mostly of no use. The
+// data stays in the file.
+void StreamBuffer::dropQueued()
+{
+    ring.consume(ring.readable());
+    hasCurrent = false;
+}
+
+StreamBufferStats StreamBuffer::getStats() const
+{
+    StreamBufferStats stats;
+    stats.ringBytes = ringBytes;
+    stats.diskBytes = diskBytes;
+    stats.spilled   = spilled;
+    stats.waits     = waits;
+    stats.wakeups   = wakeups;
+    return stats;
+}
+}
@@ -0,0 +1,139 @@
+#ifndef STREAM_BUFFER_HPP
+#define STREAM_BUFFER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+
+#include "spsc-ring.hpp"
+
+namespace gmusic
+{
+
+struct StreamBufferStats {
+    uint64_t ringBytes = 0;
+    uint64_t diskBytes = 0;
+    uint64_t spilled   = 0;
+    uint64_t waits     = 0;
+    uint64_t wakeups   = 0;
+};
+
+// Sorted, disjoint [start, end) byte ranges present in a sparse file.
+class ByteRangeSet
+{
+  public:
+    void add(uint64_t start, uint64_t end);
+    void clear();
+    bool contains(uint64_t offset) const;
+    uint64_t missingFrom(uint64_t offset) const;
+    uint64_t nextStart(uint64_t offset) const;
+    uint64_t size() const { return bytes; }
+
+  private:
+    using Ranges = std::map<uint64_t, uint64_t>;
+    Ranges::const_iterator find(uint64_t offset) const;
+
+    Ranges ranges;
+    uint64_t bytes = 0;
+};
+
+// Hands a download over from the thread that writes it to a file to the
+// thread that decodes it.
+//
+// Each chunk goes to the file first and is then pushed into a lock-free
+// single producer, single consumer ring as a record tagged with its file
+// offset. The reader takes bytes from the ring without a syscall or a lock,
+// and reads from the file with pread only where the ring has nothing for
+// its offset: after a seek, or when chunks were spilled because the ring
+// was full.
+//
+// The file may be sparse when the download jumps ahead for a seek, so the
+// ranges written so far are kept in a ByteRangeSet. The contiguous prefix,
+// which is all there is unless the download jumped, is an atomic of its own
+// and grows without a lock; the set and its mutex are only needed for the
+// ranges past the first gap.
+//
+// A waiting reader is woken once wakeupThreshold bytes have arrived or the
+// download has finished, not on every chunk.
+class StreamBuffer
+{
+  public:
+    static const size_t defaultCapacity = 1 << 20;
+    static const size_t wakeupThreshold = 32 * 1024;
+
+    explicit StreamBuffer(size_t capacity = defaultCapacity);
+
+    // Neither side may be running.
+    void reset(int fd, uint64_t stored, bool complete);
+
+    // Producer side; data has already been written to the file.
+    void append(uint64_t offset, const char *data, size_t len);
+    void markStored(uint64_t start, uint64_t end);
+    void finish();
+
+    // Consumer side.
+    size_t read(uint64_t offset, char *buffer, size_t len);
+    void dropQueued();
+    template <class Predicate> void wait(Predicate ready);
+
+    bool hasData(uint64_t offset) const;
+    uint64_t missingFrom(uint64_t offset) const;
+    uint64_t nextStored(uint64_t offset) const;
+    uint64_t storedBytes() const;
+    bool isComplete() const { return complete; }
+    void wake();
+
+    StreamBufferStats getStats() const;
+
+  private:
+    struct Record {
+        uint64_t offset = 0;
+        uint64_t len    = 0;
+    };
+
+    SpscRing ring;
+
+    // Consumer state: the record being read and how much of it is used.
+    Record current;
+    uint64_t consumed = 0;
+    bool hasCurrent   = false;
+
+    int fd = -1;
+    // [0, prefixEnd) is stored. The set may lag behind it for that range,
+    // and holds every range after the first gap, all of which start past
+    // nextRangeStart, which only the producer uses.
+    std::atomic<uint64_t> prefixEnd{0};
+    std::atomic<uint64_t> detachedBytes{0};
+    uint64_t nextRangeStart = UINT64_MAX;
+    ByteRangeSet stored;
+    mutable std::mutex storedMutex;
+    std::atomic_bool complete{false};
+    std::atomic_bool consumerWaiting{false};
+    size_t pendingWakeBytes = 0;
+
+    mutable std::mutex mutex;
+    std::condition_variable condvar;
+
+    std::atomic<uint64_t> ringBytes{0};
+    std::atomic<uint64_t> diskBytes{0};
+    std::atomic<uint64_t> spilled{0};
+    std::atomic<uint64_t> waits{0};
+    std::atomic<uint64_t> wakeups{0};
+};
+
+// Blocks until ready() holds or 100 ms have passed; callers check again.
+// The timeout covers a download that stalls below the wakeup threshold.
+template <class Predicate> void StreamBuffer::wait(Predicate ready)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    ++waits;
+    consumerWaiting = true;
+    condvar.wait_for(lock, std::chrono::milliseconds(100), ready);
+    consumerWaiting = false;
+}
+}
+
+#endif // STREAM_BUFFER_HPP
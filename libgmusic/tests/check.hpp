@@ -0,0 +1,31 @@
+#ifndef CHECK_HPP
+#define CHECK_HPP
+
+#include <iostream>
+
+namespace gmusic
+{
+namespace test
+{
+
+inline int &failures()
+{
+    static int count = 0;
+    return count;
+}
+
+inline int exitStatus() { return failures() == 0 ? 0 : 1; }
+}
+}
+
+// Reports a failed check and goes on; main returns test::exitStatus().
+#define CHECK(condition)                                                       \
+    do {                                                                       \
+        if (!(condition)) {                                                    \
+            ++gmusic::test::failures();                                        \
+            std::cerr << __FILE__ << ":" << __LINE__                           \
+                      << ": check failed: " #condition << std::endl;           \
+        }                                                                      \
+    } while (false)
+
+#endif // CHECK_HPP
@@ -0,0 +1,192 @@
+// HttpClient against a local HTTP/1.1 server: hundreds of requests in
+// flight at once all complete with their own response over a bounded set
+// of connections, and destroying the client fails what is still waiting.
+
+#include "check.hpp"
+#include "http/http-client.hpp"
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <netinet/in.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace gmusic;
+
+static const int concurrentRequests = 500;
+
+// Answers every request with its own path after a short delay, except
+// paths under /hang, which are never answered.
+class MockServer
+{
+  public:
+    MockServer()
+    {
+        listener = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address{};
+        address.sin_family      = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t size          = sizeof(address);
+        if (bind(listener, reinterpret_cast<sockaddr *>(&address), size) ||
+            listen(listener, 128) ||
+            getsockname(
+                listener, reinterpret_cast<sockaddr *>(&address), &size)) {
+            throw std::runtime_error("mock server: cannot listen");
+        }
+        port     = ntohs(address.sin_port);
+        acceptor = std::thread(&MockServer::acceptRoutine, this);
+    }
+
+    ~MockServer()
+    {
+        stopping = true;
+        shutdown(listener, SHUT_RDWR);
+        acceptor.join();
+        close(listener);
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int fd : connections) {
+            shutdown(fd, SHUT_RDWR);
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+    }
+
+    std::string url(const std::string &path) const
+    {
+        return "http://127.0.0.1:" + std::to_string(port) + path;
+    }
+
+    std::atomic_int accepted{0};
+    std::atomic_int answered{0};
+
+  private:
+    void acceptRoutine()
+    {
+        while (!stopping) {
+            int fd = accept(listener, nullptr, nullptr);
+            if (fd < 0) {
+                continue;
+            }
+            ++accepted;
+            std::lock_guard<std::mutex> lock(mutex);
+            connections.push_back(fd);
+            threads.emplace_back(&MockServer::serve, this, fd);
+        }
+    }
+
+    void serve(int fd)
+    {
+        std::string input;
+        char buffer[4096];
+        while (true) {
+            auto end = input.find("\r\n\r\n");
+            if (end == std::string::npos) {
+                auto got = recv(fd, buffer, sizeof(buffer), 0);
+                if (got <= 0) {
+                    break;
+                }
+                input.append(buffer, static_cast<size_t>(got));
+                continue;
+            }
+            auto pathStart = input.find(' ') + 1;
+            auto path = input.substr(pathStart, input.find(' ', pathStart) -
+                                                    pathStart);
+            input.erase(0, end + 4);
+            if (path.compare(0, 5, "/hang") == 0) {
+                continue;
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            auto response = "HTTP/1.1 200 OK\r\nContent-Length: " +
+                            std::to_string(path.size()) + "\r\n\r\n" + path;
+            if (send(fd, response.data(), response.size(), MSG_NOSIGNAL) <
+                0) {
+                break;
+            }
+            ++answered;
+        }
+        close(fd);
+    }
+
+    int listener;
+    int port;
+    std::atomic_bool stopping{false};
+    std::thread acceptor;
+    std::mutex mutex;
+    std::vector<int> connections;
+    std::vector<std::thread> threads;
+};
+
+static void checkConcurrentRequests()
+{
+    MockServer server;
+    std::atomic_int matched{0};
+    std::atomic_int failed{0};
+    HttpClientStats stats;
+    {
+        HttpClient client;
+        std::vector<std::future<void>> done;
+        for (int i = 0; i < concurrentRequests; ++i) {
+            auto path    = "/item/" + std::to_string(i);
+            auto promise = std::make_shared<std::promise<void>>();
+            done.push_back(promise->get_future());
+            client.send(HttpRequest(HttpMethod::GET, server.url(path)),
+                        [&, path, promise](const HttpResponse &response) {
+                            if (response.error.code != HttpErrorCode::OK ||
+                                response.status != 200) {
+                                ++failed;
+                            } else if (response.text == path) {
+                                ++matched;
+                            }
+                            promise->set_value();
+                        });
+        }
+        for (auto &future : done) {
+            CHECK(future.wait_for(std::chrono::seconds(30)) ==
+                  std::future_status::ready);
+        }
+        stats = client.getStats();
+    }
+
+    CHECK(failed == 0);
+    CHECK(matched == concurrentRequests);
+    CHECK(server.answered == concurrentRequests);
+    CHECK(stats.requests == static_cast<uint64_t>(concurrentRequests));
+    CHECK(stats.failures == 0);
+    CHECK(stats.inFlight == 0);
+    CHECK(stats.maxInFlight > 1);
+    // Requests queue for the per-host connections instead of each opening
+    // its own.
+    CHECK(server.accepted <= HttpClient::defaultMaxHostConnections);
+    CHECK(stats.connectionsOpened <=
+          static_cast<uint64_t>(HttpClient::defaultMaxHostConnections));
+}
+
+static void checkStopFailsOutstanding()
+{
+    MockServer server;
+    std::atomic_int stopped{0};
+    {
+        HttpClient client;
+        for (int i = 0; i < 20; ++i) {
+            client.send(HttpRequest(HttpMethod::GET, server.url("/hang")),
+                        [&](const HttpResponse &response) {
+                            if (response.error.code != HttpErrorCode::OK) {
+                                ++stopped;
+                            }
+                        });
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    }
+    CHECK(stopped == 20);
+}
+
+int main()
+{
+    checkConcurrentRequests();
+    checkStopFailsOutstanding();
+    return test::exitStatus();
+}
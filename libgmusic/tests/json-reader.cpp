@@ -0,0 +1,117 @@
+// JsonReader on escapes outside the BMP, deep nesting and every truncation
+// of a valid document.
+
+#include "check.hpp"
+#include "json/json-reader.hpp"
+
+#include <string>
+#include <vector>
+
+using namespace gmusic;
+using json::JsonException;
+using json::JsonReader;
+
+static std::string readOne(const std::string &text)
+{
+    JsonReader reader(text);
+    return reader.readString();
+}
+
+static bool fails(const std::string &text)
+{
+    try {
+        JsonReader reader(text);
+        reader.skipValue();
+    } catch (const JsonException &) {
+        return true;
+    }
+    return false;
+}
+
+static void checkSurrogatePairs()
+{
+    // U+1F3B5 MUSICAL NOTE.
+    CHECK(readOne(R"("\ud83c\udfb5")") == "\xF0\x9F\x8E\xB5");
+    CHECK(readOne(R"("\uD83C\uDFB5")") == "\xF0\x9F\x8E\xB5");
+    CHECK(readOne(R"("a\ud83c\udfb5b")") == "a\xF0\x9F\x8E\xB5" "b");
+    CHECK(readOne(R"("\u00e9\u4e2d")") == "\xC3\xA9\xE4\xB8\xAD");
+
+    // Unpaired halves become U+FFFD and do not swallow what follows.
+    CHECK(readOne(R"("\ud83c")") == "\xEF\xBF\xBD");
+    CHECK(readOne(R"("\udfb5x")") == "\xEF\xBF\xBDx");
+    CHECK(readOne(R"("\ud83cA")") == "\xEF\xBF\xBD" "A");
+    CHECK(readOne(R"("\ud83c\ud83c\udfb5")") ==
+          "\xEF\xBF\xBD\xF0\x9F\x8E\xB5");
+
+    // Keys go through the same decoding.
+    JsonReader reader(R"({"\ud83c\udfb5": 1})");
+    std::string key;
+    reader.readObject([&](boost::string_view name) {
+        key = name.to_string();
+        reader.skipValue();
+    });
+    CHECK(key == "\xF0\x9F\x8E\xB5");
+
+    CHECK(fails(R"("\ud83c\udfb")"));
+    CHECK(fails(R"("\uzzzz")"));
+}
+
+static std::string nested(int depth)
+{
+    return std::string(depth, '[') + "1" + std::string(depth, ']');
+}
+
+static void checkDeepNesting()
+{
+    CHECK(!fails(nested(JsonReader::maxDepth)));
+    CHECK(fails(nested(JsonReader::maxDepth + 1)));
+    // Far deeper than the stack would take if it were recursed into.
+    CHECK(fails(std::string(1000000, '[')));
+    std::string members;
+    for (int i = 0; i < 100000; ++i) {
+        members += "{\"a\":";
+    }
+    CHECK(fails(members));
+
+    std::string objects;
+    for (int i = 0; i < JsonReader::maxDepth; ++i) {
+        objects += "{\"a\":";
+    }
+    objects += "null" + std::string(JsonReader::maxDepth, '}');
+    CHECK(!fails(objects));
+
+    // Depth is given back on the way out, so siblings do not add up.
+    std::string siblings = "[";
+    for (int i = 0; i < 10; ++i) {
+        siblings += (i > 0 ? "," : "") + nested(JsonReader::maxDepth - 1);
+    }
+    CHECK(!fails(siblings + "]"));
+}
+
+static void checkTruncatedInput()
+{
+    const std::string document =
+        R"({"kind": "sj#trackList", "nextPageToken": "KjQ\"x",)"
+        R"( "data": {"items": [{"id": "1", "title": "A \u00e9\ud83c\udfb5",)"
+        R"( "durationMillis": "215000", "trackNumber": 3,)"
+        R"( "deleted": false, "artistId": ["Ab", "Cd"],)"
+        R"( "albumArtRef": null}, {"year": -1.5e3}]}})";
+    CHECK(!fails(document));
+
+    for (size_t size = 0; size < document.size(); ++size) {
+        auto prefix = document.substr(0, size);
+        if (!fails(prefix)) {
+            std::cerr << "truncated at " << size << " was accepted"
+                      << std::endl;
+            CHECK(false);
+        }
+    }
+}
+
+int main()
+{
+    checkSurrogatePairs();
+    checkDeepNesting();
+    checkTruncatedInput();
+    return test::exitStatus();
+}
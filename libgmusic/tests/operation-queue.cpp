@@ -0,0 +1,92 @@
+// Per-token ordering of OperationQueue, also across unregister(), and
+// workers surviving tasks that throw.
+
+#include "check.hpp"
+#include "operation-queue.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+using namespace gmusic;
+
+static void checkTokenOrder()
+{
+    OperationQueue queue(4);
+    int token;
+    std::atomic_int running{0};
+    std::atomic_int overlaps{0};
+    std::vector<int> order;
+
+    for (int i = 0; i < 200; ++i) {
+        queue.scheduleTask(
+            [&, i] {
+                if (++running > 1) {
+                    ++overlaps;
+                }
+                order.push_back(i);
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+                --running;
+            },
+            &token);
+    }
+    queue.wait();
+    CHECK(overlaps == 0);
+    CHECK(order.size() == 200);
+    for (size_t i = 0; i < order.size(); ++i) {
+        CHECK(order[i] == static_cast<int>(i));
+    }
+}
+
+// A task that drops its own token and schedules another one for it must
+// not have the new one run beside it.
+static void checkSelfUnregister()
+{
+    OperationQueue queue(4);
+    int token;
+    std::atomic_int running{0};
+    std::atomic_int overlaps{0};
+    std::atomic_int done{0};
+
+    auto task = [&] {
+        if (++running > 1) {
+            ++overlaps;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        --running;
+        ++done;
+    };
+    queue.scheduleTask(
+        [&] {
+            ++running;
+            queue.unregister(&token);
+            queue.scheduleTask(task, &token);
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            --running;
+            ++done;
+        },
+        &token);
+    queue.wait();
+    CHECK(done == 2);
+    CHECK(overlaps == 0);
+}
+
+static void checkThrowingTasks()
+{
+    OperationQueue queue(2);
+    int token;
+    std::atomic_int done{0};
+    queue.scheduleTask([] { throw 42; }, &token);
+    queue.scheduleTask([] { throw std::runtime_error("failed"); }, &token);
+    queue.scheduleTask([&done] { ++done; }, &token);
+    queue.wait();
+    CHECK(done == 1);
+}
+
+int main()
+{
+    checkTokenOrder();
+    checkSelfUnregister();
+    checkThrowingTasks();
+    return test::exitStatus();
+}
@@ -0,0 +1,125 @@
+// PcmGain: the SSE2 and AVX2 kernels give the scalar result sample for
+// sample, on buffers of every length around the vector widths, and a
+// volume change ramps in instead of stepping.
+
+#include "check.hpp"
+#include "pcm-gain.hpp"
+
+#include <random>
+#include <vector>
+
+using namespace gmusic;
+using Kernel = PcmGain::Kernel;
+
+static std::vector<int16_t> makeSamples(size_t count)
+{
+    std::mt19937 random(1);
+    std::vector<int16_t> samples(count);
+    for (auto &sample : samples) {
+        sample = static_cast<int16_t>(random());
+    }
+    // The extremes, where a wrong rounding or shift shows first.
+    const int16_t edges[] = {-32768, 32767, -1, 1, 0, -32767};
+    for (size_t i = 0; i < sizeof(edges) / sizeof(edges[0]); ++i) {
+        if (i < count) {
+            samples[i] = edges[i];
+        }
+    }
+    return samples;
+}
+
+static void checkKernel(Kernel kernel, const char *name)
+{
+    std::vector<int16_t> probe(1);
+    if (!PcmGain::scaleWith(kernel, probe.data(), probe.size(), 1)) {
+        std::cerr << name << " not available, skipped" << std::endl;
+        return;
+    }
+
+    const int32_t gains[] = {1, 2, 255, 16384, 23170, 32766, 32767};
+    auto source           = makeSamples(1000);
+    for (int32_t gain : gains) {
+        // Lengths around 8 and 16 samples cover the scalar tail.
+        for (size_t count = 0; count <= source.size();
+             count += (count < 40 ? 1 : 97)) {
+            std::vector<int16_t> expected(source.begin(),
+                                          source.begin() + count);
+            std::vector<int16_t> actual(expected);
+            PcmGain::scaleWith(
+                Kernel::Scalar, expected.data(), expected.size(), gain);
+            PcmGain::scaleWith(kernel, actual.data(), actual.size(), gain);
+            if (actual != expected) {
+                std::cerr << name << " differs at gain " << gain << ", "
+                          << count << " samples" << std::endl;
+                CHECK(false);
+            }
+        }
+    }
+
+    // An unaligned start must not matter either.
+    std::vector<int16_t> expected(source.begin() + 1, source.end());
+    std::vector<int16_t> actual(source);
+    PcmGain::scaleWith(Kernel::Scalar, expected.data(), expected.size(), 9000);
+    PcmGain::scaleWith(kernel, actual.data() + 1, actual.size() - 1, 9000);
+    CHECK(std::vector<int16_t>(actual.begin() + 1, actual.end()) == expected);
+}
+
+static void checkScalar()
+{
+    std::vector<int16_t> samples = {-32768, 32767, 3, -3, 1, -1};
+    PcmGain::scaleWith(Kernel::Scalar, samples.data(), samples.size(), 16384);
+    CHECK(samples == std::vector<int16_t>({-16384, 16384, 2, -1, 1, 0}));
+}
+
+static void checkApply()
+{
+    auto source = makeSamples(4096);
+
+    auto samples = source;
+    PcmGain full;
+    full.apply(samples.data(), samples.size(), 2);
+    CHECK(samples == source);
+
+    PcmGain mute(0);
+    mute.apply(samples.data(), samples.size(), 2);
+    CHECK(samples == std::vector<int16_t>(source.size(), 0));
+
+    // At a steady volume apply() matches the scalar kernel.
+    samples       = source;
+    auto expected = source;
+    PcmGain half(0.5);
+    half.apply(samples.data(), samples.size(), 2);
+    PcmGain::scaleWith(
+        Kernel::Scalar, expected.data(), expected.size(), PcmGain::unity / 2);
+    CHECK(samples == expected);
+
+    // A change from full to silent volume steps down block by block and
+    // reaches silence only at the end of the buffer.
+    std::vector<int16_t> level(2 * 1024, 20000);
+    PcmGain ramp;
+    ramp.setVolume(0);
+    ramp.apply(level.data(), level.size(), 2);
+    size_t block = PcmGain::rampBlockFrames * 2;
+    bool falling = true;
+    for (size_t i = block; i < level.size(); i += block) {
+        falling = falling && level[i] < level[i - block];
+        falling = falling && level[i] == level[i + block - 1];
+    }
+    CHECK(falling);
+    CHECK(level.front() < 20000 && level.front() > 19000);
+    CHECK(level.back() == 0);
+
+    // The next buffer is at the new volume from its first sample.
+    std::vector<int16_t> after(64, 20000);
+    ramp.apply(after.data(), after.size(), 2);
+    CHECK(after == std::vector<int16_t>(after.size(), 0));
+}
+
+int main()
+{
+    checkScalar();
+    checkKernel(Kernel::Sse2, "SSE2");
+    checkKernel(Kernel::Avx2, "AVX2");
+    checkApply();
+    return test::exitStatus();
+}
@@ -0,0 +1,74 @@
+// The per track, artist and album lookups must be planned with their
+// indexes and never scan a table.
+
+#include "check.hpp"
+#include "db/database.hpp"
+#include "db/queries.hpp"
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/filesystem.hpp>
+
+using namespace gmusic;
+using namespace gmusic::db;
+
+struct IndexedQuery {
+    const char *name;
+    std::string query;
+    const char *index;
+};
+
+static void checkPlan(Database &db, const IndexedQuery &indexed)
+{
+    db.perform<void, ReadLock>([&indexed](Connection *con) {
+        Statement st(con, "EXPLAIN QUERY PLAN " + indexed.query);
+        bool usesIndex = indexed.index == nullptr;
+        bool scans     = false;
+        while (st.executeStep()) {
+            auto detail = st.get<std::string>(3);
+            usesIndex   = usesIndex || (detail.find(indexed.index) !=
+                                      std::string::npos);
+            scans = scans || boost::starts_with(detail, "SCAN");
+        }
+        if (!usesIndex || scans) {
+            std::cerr << indexed.name << " is not planned with "
+                      << (indexed.index ? indexed.index : "an index")
+                      << std::endl;
+        }
+        CHECK(usesIndex && !scans);
+    });
+}
+
+int main()
+{
+    namespace fs = boost::filesystem;
+    auto dir     = fs::temp_directory_path() / fs::unique_path();
+    fs::create_directories(dir);
+    {
+        Database db((dir / "plans.db").string());
+        const std::string regular = "8";
+        const IndexedQuery indexedQueries[] = {
+            {"TrackTable::forEachForAlbum",
+             queries::selectTracksForAlbum(regular),
+             "Track_album_type"},
+            {"TrackTable::forEachForArtist",
+             queries::selectTracksForArtist(regular),
+             "Track2Artist_artist_track"},
+            {"TrackTable::get", queries::selectTrack, nullptr},
+            {"TrackTable::get artists",
+             queries::selectTrackArtists,
+             "Track2Artist_track_artist"},
+            {"ArtistTable::get",
+             queries::selectArtistWithAlbums,
+             "Artist2Album_artist_album"},
+            {"AlbumTable::get", queries::selectAlbum, nullptr},
+            {"AlbumTable::get artists",
+             queries::selectAlbumArtists,
+             "Artist2Album_album_artist"},
+        };
+        for (const auto &indexed : indexedQueries) {
+            checkPlan(db, indexed);
+        }
+    }
+    fs::remove_all(dir);
+    return test::exitStatus();
+}
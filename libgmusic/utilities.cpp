@@ -4,6 +4,7 @@
 #include <algorithm>
 #include <boost/filesystem.hpp>
 #include <cassert>
+#include <cerrno>
 #include <chrono>
 #include <cstdlib>
 #include <iomanip>
@@ -15,6 +16,7 @@
 #include <openssl/rsa.h>
 #include <openssl/sha.h>
 #include <sstream>
+#include <unistd.h>
 
 namespace fs     = boost::filesystem;
 namespace chrono = std::chrono;
@@ -255,6 +257,21 @@ std::pair<std::string, std::string> encryptTrackId(const std::string &trackId)
         base64_encode(result_hash, hash_actual_size, true);
     return std::make_pair(hashed_trackId, salt);
 }
+
+std::string sha1Hex(const std::string &data)
+{
+    unsigned char hash[SHA_DIGEST_LENGTH];
+    SHA1(reinterpret_cast<const unsigned char *>(data.data()),
+         data.size(),
+         hash);
+
+    std::ostringstream hex;
+    hex << std::hex << std::setfill('0');
+    for (auto byte : hash) {
+        hex << std::setw(2) << static_cast<unsigned>(byte);
+    }
+    return hex.str();
+}
 }
 
 namespace NetUtils
@@ -357,6 +374,48 @@ void createDirectoryIfNeeded(const std::string &path)
 }
 
 bool isFileExists(const std::string &path) { return fs::exists(path); }
+
+// Writes through a temporary file so a crash never leaves a torn file
+// under the final name. The temporary name is unique, so writers of the
+// same path do not share it, and the data is synced before the rename.
+bool writeFileAtomically(const std::string &path, const std::string &contents)
+{
+    std::vector<char> tmpPath(path.begin(), path.end());
+    const char suffix[] = ".XXXXXX";
+    tmpPath.insert(tmpPath.end(), suffix, suffix + sizeof(suffix));
+    int fd = mkstemp(tmpPath.data());
+    if (fd < 0) {
+        return false;
+    }
+
+    const char *data = contents.data();
+    size_t left      = contents.size();
+    bool written     = true;
+    while (left > 0) {
+        auto count = ::write(fd, data, left);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            written = false;
+            break;
+        }
+        data += count;
+        left -= static_cast<size_t>(count);
+    }
+    written = ::fsync(fd) == 0 && written;
+    written = ::close(fd) == 0 && written;
+
+    boost::system::error_code error;
+    if (written) {
+        fs::rename(tmpPath.data(), path, error);
+    }
+    if (!written || error) {
+        fs::remove(tmpPath.data(), error);
+        return false;
+    }
+    return true;
+}
 }
 
 LogStream &Logger::getErrorLogger()
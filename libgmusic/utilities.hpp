@@ -32,6 +32,7 @@ void createDirectoryIfNeeded(const std::string &path);
 bool tryCreateDirectory(const std::string &path);
 void deleteFile(const std::string &path);
 bool isFileExists(const std::string &path);
+bool writeFileAtomically(const std::string &path, const std::string &contents);
 }
 
 namespace CryptoUtils
@@ -44,6 +45,7 @@ std::vector<Byte> base64_decode(const char *source, int slen);
 std::string encryptLoginAndPasswd(const std::string &login,
                                   const std::string &passwd);
 std::pair<std::string, std::string> encryptTrackId(const std::string &trackId);
+std::string sha1Hex(const std::string &data);
 }
 
 namespace NetUtils